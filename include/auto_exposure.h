@@ -0,0 +1,103 @@
+#ifndef LMS_CAMERA_IMPORTER_AUTO_EXPOSURE_H
+#define LMS_CAMERA_IMPORTER_AUTO_EXPOSURE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "lms/config.h"
+#include "lms/logger.h"
+#include "lms/time.h"
+
+#include "frame_statistics.h"
+#include "v4l2_wrapper.h"
+
+/**
+ * @brief Software exposure/gain loop driven by FrameStatistics.
+ *
+ * Replaces the firmware loops ("Auto Exposure", "Gain, Automatic") that
+ * change the frame timing. update() is called once per frame and only does
+ * a few float operations. The V4L2 controls are written at most
+ * `autoExposureRate` times per second by a background thread, as a UVC
+ * control transfer can take several milliseconds.
+ *
+ * Exposure is preferred over gain: gain is only raised if the exposure is
+ * already at its limit and only lowered before the exposure is reduced.
+ */
+class AutoExposure {
+public:
+    AutoExposure(lms::logging::Logger &logger, V4L2Wrapper &wrapper);
+    ~AutoExposure();
+
+    AutoExposure(const AutoExposure&) = delete;
+    AutoExposure& operator = (const AutoExposure&) = delete;
+
+    /**
+     * @brief Read the controller settings and the control ranges.
+     * @return false if the exposure control is not supported by the camera
+     */
+    bool configure(const lms::Config &config);
+
+    /**
+     * @brief Wait for a pending write and re-read the current control
+     * values, e.g. after a reconnect.
+     */
+    void reset();
+
+    /**
+     * @brief Wait until a pending control write has finished, call before
+     * closing the device.
+     */
+    void flush();
+
+    /**
+     * @brief Feed the statistics of the latest frame into the loop.
+     */
+    void update(const FrameStatistics &stats);
+
+private:
+    struct Control {
+        std::string name;
+        bool available;
+        std::int32_t minimum;
+        std::int32_t maximum;
+        std::int32_t value;
+    };
+
+    lms::logging::Logger &logger;
+    V4L2Wrapper &wrapper;
+
+    Control exposure;
+    Control gain;
+
+    float target;
+    float tolerance;
+    float maxSaturated;
+    float damping;
+    lms::Time interval;
+    lms::Time lastUpdate;
+
+    // background writer, pending/failed are guarded by mutex
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool running;
+    Control *pending;
+    std::int32_t pendingValue;
+    Control *failed;
+    std::int32_t failedValue;
+    std::int32_t failedActual;
+
+    bool initControl(Control &ctrl, const std::string &name, std::int32_t limit);
+
+    /**
+     * @brief Hand a new value to the writer thread, mutex must be held.
+     * @return true if a write was queued
+     */
+    bool queueControl(Control &ctrl, std::int32_t value);
+    void writeLoop();
+};
+
+#endif /* LMS_CAMERA_IMPORTER_AUTO_EXPOSURE_H */
@@ -0,0 +1,50 @@
+#ifndef LMS_CAMERA_IMPORTER_BAYER_H
+#define LMS_CAMERA_IMPORTER_BAYER_H
+
+#include <cstdint>
+
+#include "lms/imaging/format.h"
+
+/**
+ * @brief Colour of the top-left 2x2 quad of an 8 bit Bayer frame.
+ */
+enum class BayerPattern {
+    BGGR,  // V4L2_PIX_FMT_SBGGR8
+    GBRG,  // V4L2_PIX_FMT_SGBRG8
+    GRBG,  // V4L2_PIX_FMT_SGRBG8
+    RGGB   // V4L2_PIX_FMT_SRGGB8
+};
+
+/**
+ * @brief Map a V4L2 pixel format to its Bayer pattern.
+ * @return false if the pixel format is no 8 bit Bayer format
+ */
+bool bayerPatternFromV4L2(std::uint32_t pixelFormat, BayerPattern &pattern);
+
+/**
+ * @brief Demosaic the rows [rowBegin, rowEnd) of a full resolution image.
+ *
+ * GREY averages every 2x2 window (which always holds one red, one blue and
+ * two green samples). RGB uses bilinear interpolation, only the border
+ * rows and columns mirror their neighbours. Both are vectorised and round
+ * exactly like the scalar fallback.
+ *
+ * @param src Bayer frame of width x height bytes, e.g. the mmap buffer
+ * @param dst output image of width x height pixels in GREY or RGB
+ */
+void demosaic(const std::uint8_t *src, int width, int height, BayerPattern pattern,
+              std::uint8_t *dst, lms::imaging::Format fmt, int rowBegin, int rowEnd);
+
+/**
+ * @brief Bin every 2x2 quad into one pixel of a half resolution image.
+ *
+ * Much cheaper than demosaic(), GREY output is vectorised.
+ *
+ * @param dst output image of width/2 x height/2 pixels in GREY or RGB
+ * @param rowBegin first output row
+ * @param rowEnd last output row (exclusive)
+ */
+void demosaicBinned(const std::uint8_t *src, int width, int height, BayerPattern pattern,
+                    std::uint8_t *dst, lms::imaging::Format fmt, int rowBegin, int rowEnd);
+
+#endif /* LMS_CAMERA_IMPORTER_BAYER_H */
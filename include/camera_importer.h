@@ -5,6 +5,7 @@
 #include <cstdint>
 
 #include <vector>
+#include <future>
 
 #include <linux/videodev2.h>
 
@@ -12,6 +13,17 @@
 #include <lms/config.h>
 #include <lms/imaging/image.h>
 #include "v4l2_wrapper.h"
+#include "lazy_image.h"
+#include "frame_statistics.h"
+#include "auto_exposure.h"
+#include "change_detector.h"
+#include "frame_info.h"
+#include "undistort_map.h"
+#include "worker_pool.h"
+#include "bayer.h"
+#include "mjpeg_decoder.h"
+#include "image_pyramid.h"
+#include "frame_pool.h"
 
 
 class CameraImporter : public lms::Module {
@@ -28,7 +40,116 @@ protected:
 
     lms::WriteDataChannel<lms::imaging::Image> cameraImagePtr;
 
+    /**
+     * @brief V4L2 pixel format and size streamed by the camera.
+     */
+    std::uint32_t captureFormat;
+    int captureWidth;
+    int captureHeight;
+
+    bool bayer;
+    bool bayerBinning;
+    BayerPattern bayerPattern;
+
+    int mjpegScale;
+    MjpegDecoder *mjpeg;
+
+    /**
+     * @brief Derived format channels, e.g. IMAGE_GREY, converted on demand.
+     */
+    std::vector<lms::WriteDataChannel<LazyImage>> derivedImages;
+
+    /**
+     * @brief Greyscale pyramid levels published as IMAGE_PYRAMID_<n>.
+     */
+    std::vector<lms::WriteDataChannel<lms::imaging::Image>> pyramidImages;
+    ImagePyramid pyramid;
+
+    bool statistics;
+    lms::WriteDataChannel<FrameStatistics> statisticsPtr;
+
+    AutoExposure *autoExposure;
+
+    enum class ChangeDetection {
+        NONE,       // publish every frame
+        FLAG,       // publish every frame, mark unchanged ones as duplicates
+        SUPPRESS    // keep the last frame in IMAGE if nothing changed
+    };
+
+    ChangeDetection changeDetection;
+    ChangeDetector changeDetector;
+    int maxSkippedFrames;
+
+    /**
+     * @brief Capture target in SUPPRESS mode, last new frame in FLAG mode.
+     * Its buffer is swapped with IMAGE instead of copied.
+     */
+    lms::imaging::Image reference;
+
+    /**
+     * @brief FLAG mode: the last new frame is still in IMAGE and is swapped
+     * into reference before the next capture.
+     */
+    bool referenceInImage;
+
+    lms::WriteDataChannel<FrameInfo> frameInfoPtr;
+
+    /**
+     * @brief Capture time of the frame returned by captureFrame().
+     */
+    lms::Time captureTimestamp;
+
+    /**
+     * @brief Decide if the captured frame is published as a new frame.
+     * @param captured image the frame was captured into
+     * @return true if the frame is new, false for a duplicate
+     */
+    bool publishFrame(lms::imaging::Image &captured);
+
+    /**
+     * @brief Lens undistortion applied while reading the capture buffer,
+     * empty if disabled.
+     */
+    UndistortMap undistortMap;
+
+    /**
+     * @brief Row bands processed in parallel by demosaic and undistortion.
+     */
+    int captureBands;
+    WorkerPool *workers;
+
+    /**
+     * @brief Page backing of frame buffers and the CPU they should be
+     * NUMA-local to (-1 for any).
+     */
+    HugePages hugePages;
+    int captureCpu;
+
     V4L2Wrapper *wrapper;
+
+    /**
+     * @brief Result of setupDevice() if it runs in the background.
+     */
+    std::future<bool> setupResult;
+    bool setupPending;
+
+    /**
+     * @brief The background setupDevice() failed, cycle() keeps failing.
+     */
+    bool setupFailed;
+
+    /**
+     * @brief Open and configure the camera, the ioctl-heavy part of
+     * initialize(). Independent steps overlap if overlapInit is set and
+     * the duration of every step is logged.
+     */
+    bool setupDevice();
+
+    /**
+     * @brief Capture the next frame into target, applying all configured
+     * capture-time processing.
+     */
+    bool captureFrame(lms::imaging::Image &target);
 };
 
 
@@ -0,0 +1,51 @@
+#ifndef LMS_CAMERA_IMPORTER_CHANGE_DETECTOR_H
+#define LMS_CAMERA_IMPORTER_CHANGE_DETECTOR_H
+
+#include <cstdint>
+#include <vector>
+
+#include "lms/imaging/image.h"
+
+/**
+ * @brief Decide if a frame differs from a reference frame.
+ *
+ * Reads every gridStep-th row in full and sums the absolute differences
+ * with SSE2 per block of 8 sampled rows and about as many pixels. The
+ * frame counts as changed if the mean absolute difference of any single
+ * block exceeds the threshold, so small objects are not averaged away by
+ * a static background.
+ */
+class ChangeDetector {
+public:
+    ChangeDetector();
+
+    /**
+     * @param gridStep distance between sampled rows
+     * @param threshold mean absolute difference per byte within a block,
+     * e.g. 6.0
+     */
+    void configure(int gridStep, float threshold);
+
+    /**
+     * @brief Compare two frames of the same size and format.
+     * @return true if the frame has changed meaningfully
+     */
+    bool changed(const lms::imaging::Image &frame, const lms::imaging::Image &reference);
+
+    /**
+     * @brief Largest block difference computed by the last call to changed(),
+     * only up to the first changed block row.
+     */
+    float lastDifference() const;
+
+private:
+    int gridStep;
+    float threshold;
+    float difference;
+
+    // per block column sums of the current block row
+    std::vector<std::uint32_t> blockSad;
+    std::vector<std::uint32_t> blockSamples;
+};
+
+#endif /* LMS_CAMERA_IMPORTER_CHANGE_DETECTOR_H */
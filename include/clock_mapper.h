@@ -0,0 +1,75 @@
+#ifndef LMS_CAMERA_IMPORTER_CLOCK_MAPPER_H
+#define LMS_CAMERA_IMPORTER_CLOCK_MAPPER_H
+
+#include <time.h>
+
+#include <cstdint>
+#include <deque>
+
+#include "lms/time.h"
+
+/**
+ * @brief Maps timestamps of a kernel clock into lms::Time.
+ *
+ * V4L2 drivers stamp buffers with CLOCK_MONOTONIC or, on old drivers,
+ * with the wall clock. Neither is guaranteed to be the clock behind
+ * lms::Time::now(), so the offset between both clocks is sampled
+ * periodically and a linear model (offset + drift) is fitted over a
+ * sliding window. Each sample brackets the source clock read by two
+ * lms::Time::now() calls and keeps the tightest of a few attempts.
+ */
+class ClockMapper {
+public:
+    explicit ClockMapper(clockid_t clock = CLOCK_MONOTONIC);
+
+    /**
+     * @brief Switch the source clock, drops all samples.
+     */
+    void setClock(clockid_t clock);
+
+    clockid_t clock() const;
+
+    /**
+     * @brief Take a new offset sample if the sample interval has passed.
+     *
+     * Cheap enough to be called once per frame.
+     */
+    void update();
+
+    /**
+     * @brief Map a timestamp of the source clock into lms::Time.
+     * @param sourceMicros microseconds of the source clock
+     */
+    lms::Time map(std::int64_t sourceMicros);
+
+    /**
+     * @brief Current offset lms::Time - source clock in microseconds.
+     */
+    double offset() const;
+
+    /**
+     * @brief Estimated drift of lms::Time against the source clock in ppm.
+     */
+    double driftPpm() const;
+
+private:
+    struct Sample {
+        std::int64_t source;
+        double offset;
+    };
+
+    clockid_t sourceClock;
+    std::deque<Sample> samples;
+    std::int64_t lastSample;
+    std::int64_t baseOffset;
+
+    // offset(source) = intercept + slope * (source - reference)
+    std::int64_t reference;
+    double intercept;
+    double slope;
+
+    static std::int64_t now(clockid_t clock);
+    void fit();
+};
+
+#endif /* LMS_CAMERA_IMPORTER_CLOCK_MAPPER_H */
@@ -0,0 +1,38 @@
+#ifndef LMS_CAMERA_IMPORTER_FRAME_INFO_H
+#define LMS_CAMERA_IMPORTER_FRAME_INFO_H
+
+#include <cstdint>
+
+#include "lms/time.h"
+
+/**
+ * @brief Meta data published with every captured frame on IMAGE_INFO.
+ */
+struct FrameInfo {
+    /**
+     * @brief Incremented whenever IMAGE contains a new frame, stays the
+     * same for duplicates.
+     */
+    std::uint64_t sequence;
+
+    /**
+     * @brief True if the captured frame did not differ from the last
+     * published one and can be skipped by downstream modules.
+     */
+    bool duplicate;
+
+    /**
+     * @brief Number of duplicates captured since the last new frame.
+     */
+    std::uint32_t skipped;
+
+    /**
+     * @brief Capture time of the frame in IMAGE, taken from the V4L2
+     * buffer and mapped into the lms::Time clock.
+     */
+    lms::Time timestamp;
+
+    FrameInfo() : sequence(0), duplicate(false), skipped(0) {}
+};
+
+#endif /* LMS_CAMERA_IMPORTER_FRAME_INFO_H */
@@ -0,0 +1,86 @@
+#ifndef LMS_CAMERA_IMPORTER_FRAME_POOL_H
+#define LMS_CAMERA_IMPORTER_FRAME_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief How pool memory is backed.
+ */
+enum class HugePages {
+    NONE,         // regular 4 KiB pages
+    TRANSPARENT,  // madvise(MADV_HUGEPAGE), kernel may use 2 MiB pages
+    EXPLICIT      // MAP_HUGETLB, needs reserved pages in /proc/sys/vm/nr_hugepages
+};
+
+/**
+ * @brief Parse "none", "transparent" or "explicit".
+ * @return false if the name is unknown
+ */
+bool hugePagesFromString(const std::string &name, HugePages &mode);
+
+/**
+ * @brief Ask the kernel to back the 2 MiB aligned part of an existing
+ * allocation with transparent huge pages.
+ *
+ * Useful for buffers the module does not allocate itself, e.g. the data
+ * of published images. Allocations below 4 MiB may contain no such part,
+ * e.g. a 320x240 YUYV frame is not affected at all.
+ *
+ * @return false if no part of the allocation was advised
+ */
+bool adviseHugePages(void *data, std::size_t size);
+
+/**
+ * @brief Fault in every page of an allocation without changing its content.
+ *
+ * With cpu >= 0 the pages are touched from a thread pinned to that CPU, so
+ * first-touch places pages that were not faulted in yet on its NUMA node.
+ */
+void touchPages(void *data, std::size_t size, int cpu);
+
+/**
+ * @brief Check if the system has more than one NUMA node, otherwise
+ * placing memory near a CPU has no effect.
+ */
+bool hasMultipleNumaNodes();
+
+/**
+ * @brief Fixed number of equally sized frame buffers in one mapping.
+ *
+ * All memory is mapped and touched once by init(), optionally from a
+ * thread pinned to the capture CPU so first-touch places the pages on its
+ * NUMA node. The buffers live until the next init() or destruction.
+ */
+class FramePool {
+public:
+    FramePool();
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator = (const FramePool&) = delete;
+
+    /**
+     * @param count number of buffers
+     * @param size bytes per buffer
+     * @param mode page backing, EXPLICIT falls back to TRANSPARENT
+     * @param cpu CPU whose NUMA node should hold the memory, -1 for any
+     * @return false if the memory could not be mapped
+     */
+    bool init(std::size_t count, std::size_t size, HugePages mode, int cpu);
+
+    /**
+     * @brief Buffer number index, 0 <= index < count.
+     */
+    std::uint8_t* buffer(std::size_t index);
+
+private:
+    std::uint8_t *memory;
+    std::size_t mappedSize;
+    std::size_t stride;
+
+    void destroy();
+};
+
+#endif /* LMS_CAMERA_IMPORTER_FRAME_POOL_H */
@@ -0,0 +1,71 @@
+#ifndef LMS_CAMERA_IMPORTER_FRAME_STATISTICS_H
+#define LMS_CAMERA_IMPORTER_FRAME_STATISTICS_H
+
+#include <array>
+#include <cstdint>
+
+#include "lms/imaging/format.h"
+
+/**
+ * @brief Luma statistics of a captured frame.
+ *
+ * Computed on a subsample grid while the frame is copied out of the
+ * capture buffer, so consumers do not need to scan the image again.
+ * Mean and the dark/saturated counters use every pixel of each sampled row,
+ * the histogram only every gridStep-th pixel of those rows.
+ */
+struct FrameStatistics {
+    // settings, filled in by the importer
+    int gridStep;
+    std::uint8_t darkLevel;
+    std::uint8_t saturationLevel;
+
+    // results
+    std::uint32_t pixels;
+    std::uint64_t lumaSum;
+    std::uint32_t dark;
+    std::uint32_t saturated;
+    std::uint32_t histogramSamples;
+    std::array<std::uint32_t, 256> histogram;
+
+    FrameStatistics();
+
+    /**
+     * @brief Clear all results, settings are kept.
+     */
+    void reset();
+
+    float meanBrightness() const;
+    float darkRatio() const;
+    float saturatedRatio() const;
+};
+
+/**
+ * @brief Copy a frame and accumulate its statistics in the same pass.
+ *
+ * Supports GREY, YUYV and RGB, where the luma is (R + 2G + B) / 4 like in
+ * the image pyramid. For other formats the frame is only copied.
+ *
+ * @param dst destination buffer or nullptr to only compute statistics
+ * @param src source buffer, e.g. a memory mapped V4L2 buffer
+ * @param width width of the frame in pixels
+ * @param height height of the frame in pixels
+ * @param fmt pixel format of src and dst
+ * @param stats result, reset before accumulating
+ */
+void copyWithStatistics(std::uint8_t *dst, const std::uint8_t *src,
+                        int width, int height, lms::imaging::Format fmt,
+                        FrameStatistics &stats);
+
+/**
+ * @brief Copy the rows [rowBegin, rowEnd) of a frame and add their
+ * statistics to stats without resetting it.
+ *
+ * Lets the caller interleave the copy with other per-row work, e.g.
+ * building an image pyramid while the rows are still in cache.
+ */
+void copyRowsWithStatistics(std::uint8_t *dst, const std::uint8_t *src,
+                            int width, int rowBegin, int rowEnd, lms::imaging::Format fmt,
+                            FrameStatistics &stats);
+
+#endif /* LMS_CAMERA_IMPORTER_FRAME_STATISTICS_H */
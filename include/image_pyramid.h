@@ -0,0 +1,52 @@
+#ifndef LMS_CAMERA_IMPORTER_IMAGE_PYRAMID_H
+#define LMS_CAMERA_IMPORTER_IMAGE_PYRAMID_H
+
+#include <cstdint>
+#include <vector>
+
+#include "lms/imaging/image.h"
+
+/**
+ * @brief Average two rows of GREY pixels into one row of half width.
+ * @param outWidth number of output pixels, row0/row1 need 2 * outWidth
+ */
+void reduceGreyRows(const std::uint8_t *row0, const std::uint8_t *row1,
+                    std::uint8_t *out, int outWidth);
+
+/**
+ * @brief Greyscale pyramid of a camera frame with 2x2 box reduction.
+ *
+ * Level i has half the width and height of level i - 1, level 0 is the
+ * frame itself. The level images are owned by the caller (usually data
+ * channels) and must be preallocated as GREY with the right size.
+ *
+ * reduceRows() can be called on row blocks right after they were copied,
+ * so the first level is built while the frame is still in cache.
+ */
+class ImagePyramid {
+public:
+    void setLevels(const std::vector<lms::imaging::Image*> &levels);
+
+    bool empty() const;
+
+    /**
+     * @brief Reduce the rows [rowBegin, rowEnd) of the frame into level 1.
+     * @param rowBegin must be even
+     */
+    void reduceRows(const lms::imaging::Image &frame, int rowBegin, int rowEnd);
+
+    /**
+     * @brief Compute level 2 and above from level 1.
+     */
+    void finish();
+
+    /**
+     * @brief Build all levels from the frame in one call.
+     */
+    void build(const lms::imaging::Image &frame);
+
+private:
+    std::vector<lms::imaging::Image*> levels;
+};
+
+#endif /* LMS_CAMERA_IMPORTER_IMAGE_PYRAMID_H */
@@ -0,0 +1,76 @@
+#ifndef LMS_CAMERA_IMPORTER_LAZY_IMAGE_H
+#define LMS_CAMERA_IMPORTER_LAZY_IMAGE_H
+
+#include <cstdint>
+#include <mutex>
+
+#include "lms/imaging/format.h"
+#include "lms/imaging/image.h"
+#include "lms/logger.h"
+
+/**
+ * @brief Camera frame in a derived pixel format that is only converted
+ * when a consumer actually asks for it.
+ *
+ * The importer publishes one LazyImage per configured derived format and
+ * calls invalidate() whenever a new frame is captured. The first call to
+ * get() in that cycle converts the source frame, every further call returns
+ * the cached result until the next frame arrives.
+ */
+class LazyImage {
+public:
+    LazyImage();
+    LazyImage(const LazyImage &obj);
+    LazyImage& operator = (const LazyImage &obj);
+
+    /**
+     * @brief Bind this image to the frame it is derived from.
+     * @param source image that is converted, must outlive this object
+     * @param format target pixel format, e.g. GREY or RGB
+     * @param logger reports failed conversions, may be nullptr
+     */
+    void setSource(const lms::imaging::Image *source, lms::imaging::Format format,
+                   lms::logging::Logger *logger = nullptr);
+
+    /**
+     * @brief Mark the cached conversion as stale, called once per new frame.
+     */
+    void invalidate();
+
+    /**
+     * @brief Return the source frame converted to format().
+     *
+     * Converts on the first call after invalidate(), afterwards the cached
+     * image is returned. Safe to call from several modules concurrently.
+     * If the conversion fails the returned image is empty.
+     */
+    const lms::imaging::Image& get() const;
+
+    /**
+     * @brief Check if the current frame was already converted.
+     * @return true if get() would not trigger a conversion
+     */
+    bool isConverted() const;
+
+    lms::imaging::Format format() const;
+
+    /**
+     * @brief Number of conversions done so far, useful for profiling.
+     */
+    std::uint64_t conversions() const;
+
+private:
+    const lms::imaging::Image *source;
+    lms::imaging::Format targetFormat;
+    lms::logging::Logger *logger;
+
+    std::uint64_t frame;
+    mutable std::uint64_t convertedFrame;
+    mutable std::uint64_t numConversions;
+    mutable bool failed;
+
+    mutable lms::imaging::Image cache;
+    mutable std::mutex mutex;
+};
+
+#endif /* LMS_CAMERA_IMPORTER_LAZY_IMAGE_H */
@@ -0,0 +1,101 @@
+#ifndef LMS_CAMERA_IMPORTER_MJPEG_DECODER_H
+#define LMS_CAMERA_IMPORTER_MJPEG_DECODER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "lms/imaging/format.h"
+#include "lms/imaging/image.h"
+#include "lms/logger.h"
+
+#include "v4l2_wrapper.h"
+#include "worker_pool.h"
+#include "frame_pool.h"
+
+/**
+ * @brief Decodes MJPEG frames from the capture buffers on a WorkerPool.
+ *
+ * Each dequeued buffer is handed to a worker and only given back to the
+ * driver once its frame was collected, so the compressed data is never
+ * copied. With a pool of n threads up to n + 1 frames are decoded in
+ * parallel, which adds the same number of frames of latency. With read IO
+ * there is only one buffer and frames are decoded one at a time.
+ *
+ * Fast paths: GREY output only decodes the luma channel and scale 2, 4 or 8
+ * lets libjpeg skip most of the IDCT work. Every slot keeps its libjpeg
+ * decompressor from init() on instead of creating one per frame.
+ */
+class MjpegDecoder {
+public:
+    MjpegDecoder(lms::logging::Logger &logger, V4L2Wrapper &wrapper, WorkerPool &workers);
+    ~MjpegDecoder();
+
+    /**
+     * @param width width of the decoded (scaled) frame
+     * @param height height of the decoded (scaled) frame
+     * @param fmt GREY, YUYV or RGB
+     * @param scale 1, 2, 4 or 8
+     * @param hugePages backing of the decode buffers
+     * @param cpu CPU the decode buffers should be local to, -1 for any
+     * @return false if format or scale are not supported
+     */
+    bool init(int width, int height, lms::imaging::Format fmt, int scale,
+              HugePages hugePages = HugePages::NONE, int cpu = -1);
+
+    /**
+     * @brief Dequeue frames until the pipeline is full, then return the
+     * oldest decoded frame.
+     * @param timestamp set to the capture time of the returned frame
+     * @return false if dequeuing or decoding failed
+     */
+    bool capture(lms::imaging::Image &image, lms::Time &timestamp);
+
+    /**
+     * @brief Wait for all frames in flight and give their buffers back,
+     * must be called before the device is closed.
+     */
+    void flush();
+
+    static bool isSupported();
+
+private:
+    /**
+     * @brief libjpeg state, kept out of the header as libjpeg is optional.
+     */
+    struct Decompressor;
+
+    struct Slot {
+        V4L2Wrapper::Frame frame;
+        Decompressor *jpeg;
+        std::uint8_t *buffer;
+        std::vector<std::uint8_t> row;
+        bool done;
+        bool ok;
+    };
+
+    lms::logging::Logger &logger;
+    V4L2Wrapper &wrapper;
+    WorkerPool &workers;
+
+    int width;
+    int height;
+    lms::imaging::Format format;
+    int scale;
+    std::size_t depth;
+    FramePool pool;
+
+    // ring of depth slots, inFlight frames starting at slots[head]
+    std::vector<Slot> slots;
+    std::size_t head;
+    std::size_t inFlight;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    bool submit();
+    void destroySlots();
+};
+
+#endif /* LMS_CAMERA_IMPORTER_MJPEG_DECODER_H */
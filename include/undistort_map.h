@@ -0,0 +1,77 @@
+#ifndef LMS_CAMERA_IMPORTER_UNDISTORT_MAP_H
+#define LMS_CAMERA_IMPORTER_UNDISTORT_MAP_H
+
+#include <cstdint>
+#include <vector>
+
+#include "lms/config.h"
+#include "lms/imaging/format.h"
+
+/**
+ * @brief Pinhole camera with radial/tangential lens distortion
+ * (same parameters as OpenCV's calibrateCamera).
+ */
+struct CameraCalibration {
+    double fx, fy, cx, cy;
+    double k1, k2, p1, p2, k3;
+
+    CameraCalibration();
+
+    /**
+     * @brief Read cameraFx, cameraFy, cameraCx, cameraCy and
+     * distK1, distK2, distP1, distP2, distK3 from the config.
+     * @return false if the focal length or the principal point is missing
+     */
+    bool fromConfig(const lms::Config &config);
+};
+
+/**
+ * @brief Precomputed fixed-point remap table for lens undistortion.
+ *
+ * For every output pixel the table stores the index of the top-left source
+ * neighbour and 7 bit bilinear weights, 6 bytes per pixel. The map is built
+ * once at init, apply() then only gathers and interpolates, which lets the
+ * importer write the rectified image directly from the capture buffer.
+ *
+ * Supports GREY, YUYV (bilinear luma, nearest chroma) and RGB.
+ */
+class UndistortMap {
+public:
+    UndistortMap();
+
+    /**
+     * @brief Build the remap table, the output keeps the input camera matrix.
+     * @return false if the format is not supported
+     */
+    bool init(const CameraCalibration &calib, int width, int height,
+              lms::imaging::Format fmt);
+
+    bool empty() const;
+
+    /**
+     * @brief Remap the rows [rowBegin, rowEnd) of the output image.
+     *
+     * Disjoint row bands can be processed by different threads.
+     *
+     * @param src distorted frame
+     * @param dst rectified frame, must not alias src
+     */
+    void apply(const std::uint8_t *src, std::uint8_t *dst, int rowBegin, int rowEnd) const;
+
+    int height() const;
+
+private:
+    int w, h;
+    lms::imaging::Format format;
+
+    std::vector<std::int32_t> offsets;  // -1 if outside of the source
+    std::vector<std::uint8_t> weightsX;
+    std::vector<std::uint8_t> weightsY;
+
+    void applyLuma(const std::uint8_t *src, std::uint8_t *dst, int stride,
+                   int rowBegin, int rowEnd) const;
+    void applyChroma(const std::uint8_t *src, std::uint8_t *dst, int rowBegin, int rowEnd) const;
+    void applyRGB(const std::uint8_t *src, std::uint8_t *dst, int rowBegin, int rowEnd) const;
+};
+
+#endif /* LMS_CAMERA_IMPORTER_UNDISTORT_MAP_H */
@@ -19,6 +19,10 @@
 #include "lms/imaging/format.h"
 #include "lms/imaging/image.h"
 #include "lms/logger.h"
+#include "lms/time.h"
+
+#include "frame_statistics.h"
+#include "clock_mapper.h"
 
 int xioctl(int64_t fh, int64_t request, void *arg);
 
@@ -32,6 +36,20 @@ class V4L2Wrapper {
         std::uint32_t framerate;
     };
 
+    /**
+     * @brief Captured frame that is still owned by the driver.
+     *
+     * Obtained by dequeueFrame() and valid until requeueFrame() is called.
+     * Lets the caller process the pixels directly from the mmap buffer.
+     */
+    struct Frame {
+        const std::uint8_t *data;
+        std::size_t bytesused;
+        lms::Time timestamp;  // capture time mapped into lms::Time
+        std::uint32_t sequence;
+        std::int32_t index;  // mmap buffer index, -1 for read IO
+    };
+
     V4L2Wrapper(lms::logging::Logger& logger);
 
     /**
@@ -57,6 +75,13 @@ class V4L2Wrapper {
      */
     bool isOpen();
 
+    /**
+     * @brief Check if frames are captured with mmap streaming IO.
+     * @return true for streaming, false for read IO where every frame
+     * is read into the same buffer
+     */
+    bool isStreaming() const;
+
     /**
      * @brief Set width, height and pixel format of the captured images.
      * @param width width of a frame
@@ -66,6 +91,21 @@ class V4L2Wrapper {
      */
     bool setFormat(std::uint32_t width, std::uint32_t height, lms::imaging::Format fmt);
 
+    /**
+     * @brief Same as above but for pixel formats that have no
+     * lms::imaging::Format, e.g. raw Bayer.
+     * @param pixelFormat V4L2 fourcc, e.g. V4L2_PIX_FMT_SGRBG8
+     * @return true if the operation was successful, otherwise false
+     */
+    bool setFormat(std::uint32_t width, std::uint32_t height, std::uint32_t pixelFormat);
+
+    /**
+     * @brief Parse a capture format, either an lms::imaging::Format name or
+     * a Bayer pattern (SBGGR8, SGBRG8, SGRBG8, SRGGB8) or MJPEG.
+     * @return V4L2 fourcc or 0 if unknown
+     */
+    static std::uint32_t pixelFormatFromString(const std::string &name);
+
     /**
      * @brief Set the framerate of the camera
      * @param framerate examples are 60 or 100
@@ -86,12 +126,46 @@ class V4L2Wrapper {
     bool isValidCamera();
 
     bool setCameraSettings(const lms::Config *cameraConfig);
+
+    /**
+     * @brief Look up a control found by queryCameraControls().
+     * @param name control name, e.g. "Exposure"
+     * @param ctrl filled with id, range and default value
+     * @return true if the camera supports the control, otherwise false
+     */
+    bool queryControl(const std::string& name, struct v4l2_queryctrl &ctrl) const;
+    std::int32_t getControl(const std::string& name);
+    bool setControl(const std::string& name, std::int32_t value);
+
     bool queryCameraControls();
     bool printCameraControls();
 
     void getSupportedResolutions(std::vector<CameraResolution> &result);
 
-    bool captureImage(lms::imaging::Image &image);
+    /**
+     * @brief Capture the next frame into the given image.
+     * @param image destination, must have the configured size and format
+     * @param stats if not null, statistics are computed while copying
+     * @return true if a full frame was captured, otherwise false
+     */
+    bool captureImage(lms::imaging::Image &image, FrameStatistics *stats = nullptr);
+
+    /**
+     * @brief Wait for the next frame without copying it.
+     * @return true if a frame was dequeued, it must be given back by requeueFrame()
+     */
+    bool dequeueFrame(Frame &frame);
+
+    /**
+     * @brief Give a frame obtained by dequeueFrame() back to the driver.
+     */
+    bool requeueFrame(const Frame &frame);
+
+    /**
+     * @brief Capture time of the most recently dequeued or captured frame,
+     * mapped into the lms::Time clock.
+     */
+    lms::Time lastTimestamp() const;
 
     bool initBuffersIfNecessary();
 
@@ -107,12 +181,24 @@ class V4L2Wrapper {
 
     std::map<std::string, struct v4l2_queryctrl> cameraControls;
 
+    /**
+     * @brief Target of dequeueFrame() for read IO, sized by setFormat().
+     */
+    std::vector<std::uint8_t> readBuffer;
+
+    ClockMapper clockMapper;
+    lms::Time lastFrameTimestamp;
+
+    /**
+     * @brief Convert a buffer timestamp into lms::Time, honouring the
+     * clock reported in the buffer flags.
+     */
+    lms::Time mapTimestamp(const v4l2_buffer &buf);
+
     static std::uint32_t toV4L2(lms::imaging::Format fmt);
 
     std::int32_t getControl(std::uint32_t id);
-    std::int32_t getControl(const std::string& name);
     bool setControl(std::uint32_t id, std::int32_t value);
-    bool setControl(const std::string& name, std::int32_t value);
 
     void getSupportedFramesizes(std::vector<CameraResolution> &result, CameraResolution res);
     void getSupportedFramerates(std::vector<CameraResolution> &result,
@@ -0,0 +1,74 @@
+#ifndef LMS_CAMERA_IMPORTER_WORKER_POOL_H
+#define LMS_CAMERA_IMPORTER_WORKER_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Small pool of persistent threads for per-frame work.
+ *
+ * Threads are started once at init, so splitting a frame into bands does
+ * not pay for thread creation every cycle.
+ */
+class WorkerPool {
+public:
+    /**
+     * @param threads number of worker threads, 0 runs everything on the
+     * calling thread
+     */
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator = (const WorkerPool&) = delete;
+
+    /**
+     * @brief Run task(0) ... task(count - 1) and wait until all are done.
+     *
+     * The calling thread takes part in the work. Does not allocate, only
+     * one parallelFor() may run at a time.
+     */
+    template<typename Task>
+    void parallelFor(int count, const Task &task) {
+        runBatch(count, [](const void *context, int index) {
+            (*static_cast<const Task*>(context))(index);
+        }, &task);
+    }
+
+    /**
+     * @brief Queue a task without waiting for it.
+     *
+     * The queue only allocates when more tasks are pending than ever
+     * before.
+     */
+    void post(std::function<void()> task);
+
+    int size() const;
+
+private:
+    std::vector<std::thread> threads;
+    // ring buffer of pending post() tasks
+    std::vector<std::function<void()>> queue;
+    std::size_t queueHead;
+    std::size_t queueSize;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool running;
+
+    // current parallelFor() batch, guarded by mutex
+    void (*batchTask)(const void*, int);
+    const void *batchContext;
+    int batchCount;
+    int batchNext;
+    int batchPending;
+    std::condition_variable batchDone;
+
+    void runBatch(int count, void (*task)(const void*, int), const void *context);
+    void work();
+    void runBatchItem(std::unique_lock<std::mutex> &lock);
+};
+
+#endif /* LMS_CAMERA_IMPORTER_WORKER_POOL_H */
@@ -0,0 +1,197 @@
+#include "auto_exposure.h"
+
+#include <algorithm>
+#include <cmath>
+
+AutoExposure::AutoExposure(lms::logging::Logger &logger, V4L2Wrapper &wrapper)
+    : logger(logger), wrapper(wrapper), target(110), tolerance(8),
+      maxSaturated(0.02), damping(0.5), running(false), pending(nullptr),
+      pendingValue(0), failed(nullptr), failedValue(0), failedActual(0) {
+    exposure.available = gain.available = false;
+    exposure.minimum = exposure.maximum = exposure.value = 0;
+    gain.minimum = gain.maximum = gain.value = 0;
+}
+
+AutoExposure::~AutoExposure() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    cond.notify_all();
+
+    if(writer.joinable()) {
+        writer.join();
+    }
+}
+
+bool AutoExposure::configure(const lms::Config &config) {
+    target = config.get<float>("autoExposureTarget", 110);
+    tolerance = config.get<float>("autoExposureTolerance", 8);
+    maxSaturated = config.get<float>("autoExposureMaxSaturated", 0.02);
+    damping = std::min(1.f, std::max(0.05f, config.get<float>("autoExposureDamping", 0.5)));
+
+    int rate = std::max(1, config.get<int>("autoExposureRate", 4));
+    interval = lms::Time::fromMicros(1000 * 1000 / rate);
+    lastUpdate = lms::Time::fromMicros(0);
+
+    if(! initControl(exposure, config.get<std::string>("exposureControl", "Exposure"),
+                     config.get<int>("autoExposureMax", 0))) {
+        logger.error("autoExposure") << "Camera has no control " << exposure.name;
+        return false;
+    }
+
+    if(! initControl(gain, config.get<std::string>("gainControl", "Gain"),
+                     config.get<int>("autoGainMax", 0))) {
+        logger.warn("autoExposure") << "Camera has no control " << gain.name
+                                    << ", using exposure only";
+    }
+
+    if(! running) {
+        running = true;
+        writer = std::thread(&AutoExposure::writeLoop, this);
+    }
+
+    return true;
+}
+
+bool AutoExposure::initControl(Control &ctrl, const std::string &name, std::int32_t limit) {
+    ctrl.name = name;
+
+    v4l2_queryctrl query;
+    ctrl.available = wrapper.queryControl(name, query);
+    if(! ctrl.available) {
+        return false;
+    }
+
+    ctrl.minimum = query.minimum;
+    ctrl.maximum = query.maximum;
+    if(limit > 0) {
+        ctrl.maximum = std::min(ctrl.maximum, limit);
+    }
+    ctrl.value = wrapper.getControl(name);
+
+    return true;
+}
+
+void AutoExposure::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this] { return pending == nullptr; });
+}
+
+void AutoExposure::reset() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this] { return pending == nullptr; });
+    failed = nullptr;
+
+    if(exposure.available) {
+        exposure.value = wrapper.getControl(exposure.name);
+    }
+    if(gain.available) {
+        gain.value = wrapper.getControl(gain.name);
+    }
+    lastUpdate = lms::Time::fromMicros(0);
+}
+
+bool AutoExposure::queueControl(Control &ctrl, std::int32_t value) {
+    value = std::min(ctrl.maximum, std::max(ctrl.minimum, value));
+    if(! ctrl.available || value == ctrl.value) {
+        return false;
+    }
+
+    // assume success, the writer reports the actual value if the write fails
+    ctrl.value = value;
+    pending = &ctrl;
+    pendingValue = value;
+    cond.notify_one();
+    return true;
+}
+
+void AutoExposure::writeLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(true) {
+        cond.wait(lock, [this] { return ! running || pending != nullptr; });
+        if(! running) {
+            return;
+        }
+
+        Control *ctrl = pending;
+        std::int32_t value = pendingValue;
+        lock.unlock();
+
+        // UVC controls are USB control transfers, keep them off the cycle thread
+        bool ok = wrapper.setControl(ctrl->name, value);
+        std::int32_t actual = ok ? value : wrapper.getControl(ctrl->name);
+
+        lock.lock();
+        if(! ok) {
+            failed = ctrl;
+            failedValue = value;
+            failedActual = actual;
+        }
+        pending = nullptr;
+        cond.notify_all();
+    }
+}
+
+void AutoExposure::update(const FrameStatistics &stats) {
+    if(! exposure.available || stats.pixels == 0) {
+        return;
+    }
+
+    lms::Time now = lms::Time::now();
+    if(now - lastUpdate < interval) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(pending != nullptr) {
+        // previous write still in flight
+        return;
+    }
+    if(failed != nullptr) {
+        logger.warn("autoExposure") << "Could not set " << failed->name << " to " << failedValue;
+        failed->value = failedActual;
+        failed = nullptr;
+    }
+
+    float mean = std::max(1.f, stats.meanBrightness());
+    float desired = target;
+
+    // clipped highlights hide how bright the scene really is
+    if(stats.saturatedRatio() > maxSaturated) {
+        desired = std::min(desired, mean * 0.8f);
+    } else if(std::abs(mean - target) <= tolerance) {
+        return;
+    }
+
+    // damped multiplicative step, limited to halving/doubling per update
+    float scale = std::pow(desired / mean, damping);
+    scale = std::min(2.f, std::max(0.5f, scale));
+
+    bool changed = false;
+    if(scale > 1) {
+        std::int32_t wanted = static_cast<std::int32_t>(std::ceil(exposure.value * scale));
+        if(exposure.value < exposure.maximum) {
+            changed = queueControl(exposure, std::max(wanted, exposure.value + 1));
+        } else if(gain.available) {
+            std::int32_t step = std::max(1, (gain.maximum - gain.minimum) / 16);
+            changed = queueControl(gain, gain.value + step);
+        }
+    } else {
+        if(gain.available && gain.value > gain.minimum) {
+            std::int32_t step = std::max(1, (gain.maximum - gain.minimum) / 16);
+            changed = queueControl(gain, gain.value - step);
+        } else {
+            std::int32_t wanted = static_cast<std::int32_t>(std::floor(exposure.value * scale));
+            changed = queueControl(exposure, std::min(wanted, exposure.value - 1));
+        }
+    }
+
+    if(changed) {
+        // counts every write attempt, failed writes are rate limited too
+        lastUpdate = now;
+        logger.debug("autoExposure") << "mean " << mean << " -> exposure "
+                                     << exposure.value << " gain " << gain.value;
+    }
+}
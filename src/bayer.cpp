@@ -0,0 +1,257 @@
+#include "bayer.h"
+#include "image_pyramid.h"
+
+#include <algorithm>
+#include <linux/videodev2.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Position of the red sample inside a 2x2 quad.
+ */
+void redOffset(BayerPattern pattern, int &rx, int &ry) {
+    switch(pattern) {
+    case BayerPattern::BGGR: rx = 1; ry = 1; break;
+    case BayerPattern::GBRG: rx = 0; ry = 1; break;
+    case BayerPattern::GRBG: rx = 1; ry = 0; break;
+    case BayerPattern::RGGB:
+    default: rx = 0; ry = 0; break;
+    }
+}
+
+/**
+ * @brief Mirror a coordinate at the border, keeps the Bayer parity.
+ */
+inline int reflect(int i, int size) {
+    if(i < 0) {
+        return -i;
+    }
+    if(i >= size) {
+        return 2 * size - 2 - i;
+    }
+    return i;
+}
+
+#ifdef __SSE2__
+/**
+ * @brief (a + b + c + d + 2) >> 2 for 16 bytes, computed in 16 bit so
+ * the rounding matches the scalar code exactly.
+ */
+inline __m128i average4(__m128i a, __m128i b, __m128i c, __m128i d) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+                               _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+    __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+                               _mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+    return _mm_packus_epi16(lo, hi);
+}
+
+inline __m128i blend(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+inline __m128i loadu(const std::uint8_t *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+#endif
+
+void demosaicGrey(const std::uint8_t *src, int width, int height,
+                  std::uint8_t *dst, int rowBegin, int rowEnd) {
+    for(int y = rowBegin; y < rowEnd; y++) {
+        const std::uint8_t *r0 = src + y * width;
+        const std::uint8_t *r1 = src + reflect(y + 1, height) * width;
+        std::uint8_t *out = dst + y * width;
+        int x = 0;
+
+#ifdef __SSE2__
+        for(; x + 17 <= width; x += 16) {
+            __m128i v = average4(loadu(r0 + x), loadu(r1 + x), loadu(r0 + x + 1), loadu(r1 + x + 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), v);
+        }
+#endif
+
+        for(; x < width; x++) {
+            int x1 = reflect(x + 1, width);
+            out[x] = (r0[x] + r0[x1] + r1[x] + r1[x1] + 2) >> 2;
+        }
+    }
+}
+
+/**
+ * @brief Bilinear interpolation of one pixel from its 3x3 neighbourhood.
+ *
+ * @param redRow true if row y holds red samples
+ * @param green true if (x, y) is a green sample
+ */
+inline void interpolateRGB(int ul, int u, int ur, int l, int p, int r, int dl, int d, int dr,
+                           bool redRow, bool green, std::uint8_t *out) {
+    int cross = (l + r + u + d + 2) >> 2;
+    int diag = (ul + ur + dl + dr + 2) >> 2;
+    int horizontal = (l + r + 1) >> 1;
+    int vertical = (u + d + 1) >> 1;
+
+    // own: colour of this row, across: colour of the neighbouring rows
+    int own = green ? horizontal : p;
+    int across = green ? vertical : diag;
+    out[0] = redRow ? own : across;
+    out[1] = green ? p : cross;
+    out[2] = redRow ? across : own;
+}
+
+/**
+ * @brief Border pixel, mirrors the neighbours that are outside the frame.
+ */
+void borderRGB(const std::uint8_t *src, int width, int height, int rx, int ry,
+               int x, int y, std::uint8_t *out) {
+    const std::uint8_t *up = src + reflect(y - 1, height) * width;
+    const std::uint8_t *mid = src + y * width;
+    const std::uint8_t *down = src + reflect(y + 1, height) * width;
+    const int xl = reflect(x - 1, width), xr = reflect(x + 1, width);
+    const bool redRow = (y & 1) == ry;
+    const bool green = ((x & 1) == rx) != redRow;
+
+    interpolateRGB(up[xl], up[x], up[xr], mid[xl], mid[x], mid[xr],
+                   down[xl], down[x], down[xr], redRow, green, out);
+}
+
+void demosaicRGB(const std::uint8_t *src, int width, int height, BayerPattern pattern,
+                 std::uint8_t *dst, int rowBegin, int rowEnd) {
+    int rx, ry;
+    redOffset(pattern, rx, ry);
+
+    for(int y = rowBegin; y < rowEnd; y++) {
+        std::uint8_t *out = dst + y * width * 3;
+
+        // first and last row and frames too small for an interior
+        if(y == 0 || y == height - 1 || width < 3) {
+            for(int x = 0; x < width; x++) {
+                borderRGB(src, width, height, rx, ry, x, y, out + x * 3);
+            }
+            continue;
+        }
+
+        const std::uint8_t *up = src + (y - 1) * width;
+        const std::uint8_t *mid = src + y * width;
+        const std::uint8_t *down = src + (y + 1) * width;
+        const bool redRow = (y & 1) == ry;
+        // column parity of the red or blue samples on this row
+        const int colorParity = redRow ? rx : 1 - rx;
+
+        borderRGB(src, width, height, rx, ry, 0, y, out);
+        int x = 1;
+
+#ifdef __SSE2__
+        // lanes holding a red or blue sample, x starts odd in every block
+        alignas(16) std::uint8_t maskBytes[16];
+        for(int i = 0; i < 16; i++) {
+            maskBytes[i] = ((1 + i) & 1) == colorParity ? 0xFF : 0;
+        }
+        const __m128i color = _mm_load_si128(reinterpret_cast<const __m128i*>(maskBytes));
+
+        for(; x + 17 <= width; x += 16) {
+            __m128i ul = loadu(up + x - 1), u = loadu(up + x), ur = loadu(up + x + 1);
+            __m128i l = loadu(mid + x - 1), p = loadu(mid + x), r = loadu(mid + x + 1);
+            __m128i dl = loadu(down + x - 1), d = loadu(down + x), dr = loadu(down + x + 1);
+
+            __m128i cross = average4(l, r, u, d);
+            __m128i diag = average4(ul, ur, dl, dr);
+            __m128i horizontal = _mm_avg_epu8(l, r);
+            __m128i vertical = _mm_avg_epu8(u, d);
+
+            // own: colour of this row, across: colour of the neighbouring rows
+            __m128i own = blend(color, p, horizontal);
+            __m128i across = blend(color, diag, vertical);
+            __m128i green = blend(color, cross, p);
+
+            alignas(16) std::uint8_t planes[3][16];
+            _mm_store_si128(reinterpret_cast<__m128i*>(planes[0]), redRow ? own : across);
+            _mm_store_si128(reinterpret_cast<__m128i*>(planes[1]), green);
+            _mm_store_si128(reinterpret_cast<__m128i*>(planes[2]), redRow ? across : own);
+
+            std::uint8_t *o = out + x * 3;
+            for(int i = 0; i < 16; i++) {
+                o[i * 3] = planes[0][i];
+                o[i * 3 + 1] = planes[1][i];
+                o[i * 3 + 2] = planes[2][i];
+            }
+        }
+#endif
+
+        for(; x < width - 1; x++) {
+            interpolateRGB(up[x - 1], up[x], up[x + 1], mid[x - 1], mid[x], mid[x + 1],
+                           down[x - 1], down[x], down[x + 1],
+                           redRow, (x & 1) != colorParity, out + x * 3);
+        }
+
+        borderRGB(src, width, height, rx, ry, width - 1, y, out + (width - 1) * 3);
+    }
+}
+
+void binGrey(const std::uint8_t *src, int width, std::uint8_t *dst,
+             int outWidth, int rowBegin, int rowEnd) {
+    for(int y = rowBegin; y < rowEnd; y++) {
+        const std::uint8_t *r0 = src + 2 * y * width;
+        reduceGreyRows(r0, r0 + width, dst + y * outWidth, outWidth);
+    }
+}
+
+void binRGB(const std::uint8_t *src, int width, BayerPattern pattern, std::uint8_t *dst,
+            int outWidth, int rowBegin, int rowEnd) {
+    int rx, ry;
+    redOffset(pattern, rx, ry);
+    const int bx = 1 - rx, by = 1 - ry;
+
+    for(int y = rowBegin; y < rowEnd; y++) {
+        const std::uint8_t *quad[2] = { src + 2 * y * width, src + (2 * y + 1) * width };
+        std::uint8_t *out = dst + y * outWidth * 3;
+
+        for(int x = 0; x < outWidth; x++) {
+            out[x * 3] = quad[ry][2 * x + rx];
+            out[x * 3 + 1] = (quad[ry][2 * x + bx] + quad[by][2 * x + rx] + 1) >> 1;
+            out[x * 3 + 2] = quad[by][2 * x + bx];
+        }
+    }
+}
+
+}  // namespace
+
+bool bayerPatternFromV4L2(std::uint32_t pixelFormat, BayerPattern &pattern) {
+    switch(pixelFormat) {
+    case V4L2_PIX_FMT_SBGGR8: pattern = BayerPattern::BGGR; return true;
+    case V4L2_PIX_FMT_SGBRG8: pattern = BayerPattern::GBRG; return true;
+    case V4L2_PIX_FMT_SGRBG8: pattern = BayerPattern::GRBG; return true;
+    case V4L2_PIX_FMT_SRGGB8: pattern = BayerPattern::RGGB; return true;
+    default: return false;
+    }
+}
+
+void demosaic(const std::uint8_t *src, int width, int height, BayerPattern pattern,
+              std::uint8_t *dst, lms::imaging::Format fmt, int rowBegin, int rowEnd) {
+    rowBegin = std::max(0, rowBegin);
+    rowEnd = std::min(height, rowEnd);
+
+    if(fmt == lms::imaging::Format::GREY) {
+        demosaicGrey(src, width, height, dst, rowBegin, rowEnd);
+    } else if(fmt == lms::imaging::Format::RGB) {
+        demosaicRGB(src, width, height, pattern, dst, rowBegin, rowEnd);
+    }
+}
+
+void demosaicBinned(const std::uint8_t *src, int width, int height, BayerPattern pattern,
+                    std::uint8_t *dst, lms::imaging::Format fmt, int rowBegin, int rowEnd) {
+    rowBegin = std::max(0, rowBegin);
+    rowEnd = std::min(height / 2, rowEnd);
+
+    if(fmt == lms::imaging::Format::GREY) {
+        binGrey(src, width, dst, width / 2, rowBegin, rowEnd);
+    } else if(fmt == lms::imaging::Format::RGB) {
+        binRGB(src, width, pattern, dst, width / 2, rowBegin, rowEnd);
+    }
+}
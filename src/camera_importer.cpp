@@ -11,10 +11,19 @@
 #include <linux/videodev2.h>
 #include <lms/config.h>
 #include <string.h>
+#include <algorithm>
+#include <thread>
+#include <utility>
 //TODO: Use MMAPING!
 
 bool CameraImporter::initialize() {
     logger.info() << "Init: CameraImporter";
+    autoExposure = nullptr;
+    workers = nullptr;
+    mjpeg = nullptr;
+    wrapper = nullptr;
+    setupPending = false;
+    setupFailed = false;
 
     file = config().get<std::string>("device","");
     int width = config().get<int>("width",0);
@@ -29,64 +38,352 @@ bool CameraImporter::initialize() {
         return false;
     }
 
+    // pixel format streamed by the camera, may differ from the image format
+    std::string captureFormatName = config().get<std::string>("captureFormat",
+            lms::imaging::formatToString(format));
+    captureFormat = V4L2Wrapper::pixelFormatFromString(captureFormatName);
+    captureWidth = width;
+    captureHeight = height;
+    bayer = bayerPatternFromV4L2(captureFormat, bayerPattern);
+    bayerBinning = bayer && config().get<bool>("bayerBinning", false);
+    mjpegScale = 1;
+
+    if(captureFormat == V4L2_PIX_FMT_MJPEG) {
+        // decoded size, libjpeg rounds up
+        mjpegScale = config().get<int>("mjpegScale", 1);
+        if(mjpegScale < 1) {
+            logger.error("init") << "mjpegScale is " << mjpegScale;
+            return false;
+        }
+        width = (width + mjpegScale - 1) / mjpegScale;
+        height = (height + mjpegScale - 1) / mjpegScale;
+    } else if(bayer) {
+        if(format != lms::imaging::Format::GREY && format != lms::imaging::Format::RGB) {
+            logger.error("init") << "Bayer capture needs format GREY or RGB";
+            return false;
+        }
+        if(bayerBinning) {
+            width /= 2;
+            height /= 2;
+        }
+    } else if(captureFormat != V4L2Wrapper::pixelFormatFromString(
+                  lms::imaging::formatToString(format))) {
+        logger.error("init") << "Cannot convert capture format " << captureFormatName
+                             << " to " << format;
+        return false;
+    }
+
     // get write permission for data channel
     cameraImagePtr = writeChannel<lms::imaging::Image>("IMAGE");
     cameraImagePtr->resize(width, height, format);
 
+    captureBands = std::max(1, config().get<int>("captureThreads", 1));
+    workers = new WorkerPool(captureBands - 1);
+
+    // derived channels are only converted if somebody reads them
+    derivedImages.clear();
+    for(const std::string &name : config().getArray<std::string>("derivedFormats")) {
+        lms::imaging::Format derivedFormat = lms::imaging::formatFromString(name);
+        if(derivedFormat == lms::imaging::Format::UNKNOWN) {
+            logger.error("init") << "Derived format is " << name;
+            return false;
+        }
+
+        // let the imaging library decide, an impossible channel fails here
+        lms::imaging::Image probe(2, 2, format);
+        lms::imaging::Image converted;
+        if(derivedFormat != format && ! lms::imaging::convert(probe, converted, derivedFormat)) {
+            logger.error("init") << "Cannot derive " << name << " from " << format;
+            return false;
+        }
+
+        lms::WriteDataChannel<LazyImage> derived =
+                writeChannel<LazyImage>("IMAGE_" + lms::imaging::formatToString(derivedFormat));
+        derived->setSource(&*cameraImagePtr, derivedFormat, &logger);
+        derivedImages.push_back(derived);
+    }
+
+    // greyscale pyramid levels IMAGE_PYRAMID_1 ... IMAGE_PYRAMID_n
+    pyramidImages.clear();
+    std::vector<lms::imaging::Image*> levels;
+    int levelWidth = width, levelHeight = height;
+    for(int i = 1; i <= config().get<int>("pyramidLevels", 0); i++) {
+        levelWidth /= 2;
+        levelHeight /= 2;
+        lms::WriteDataChannel<lms::imaging::Image> level =
+                writeChannel<lms::imaging::Image>("IMAGE_PYRAMID_" + std::to_string(i));
+        level->resize(levelWidth, levelHeight, lms::imaging::Format::GREY);
+        pyramidImages.push_back(level);
+        levels.push_back(&*level);
+    }
+    pyramid.setLevels(levels);
+
+    // luma statistics computed while copying the frame
+    statistics = config().get<bool>("statistics", false)
+            || config().get<bool>("autoExposure", false);
+    if(statistics && format != lms::imaging::Format::GREY
+            && format != lms::imaging::Format::YUYV && format != lms::imaging::Format::RGB) {
+        logger.error("init") << "statistics and autoExposure need format GREY, YUYV or RGB";
+        return false;
+    }
+    if(statistics) {
+        statisticsPtr = writeChannel<FrameStatistics>("IMAGE_STATS");
+        statisticsPtr->gridStep = config().get<int>("statisticsGrid", 4);
+        statisticsPtr->darkLevel = std::min(255, std::max(0, config().get<int>("darkLevel", 5)));
+        statisticsPtr->saturationLevel =
+                std::min(255, std::max(0, config().get<int>("saturationLevel", 250)));
+    }
+
+    // skip frames that do not differ from the last published one
+    std::string changeMode = config().get<std::string>("changeDetection", "none");
+    if(changeMode == "none") {
+        changeDetection = ChangeDetection::NONE;
+    } else if(changeMode == "flag") {
+        changeDetection = ChangeDetection::FLAG;
+    } else if(changeMode == "suppress") {
+        changeDetection = ChangeDetection::SUPPRESS;
+    } else {
+        logger.error("init") << "Change detection is " << changeMode;
+        return false;
+    }
+    changeDetector.configure(config().get<int>("changeDetectionGrid", 2),
+                             config().get<float>("changeDetectionThreshold", 6));
+    maxSkippedFrames = config().get<int>("maxSkippedFrames", 10);
+    referenceInImage = false;
+    if(changeDetection != ChangeDetection::NONE) {
+        reference.resize(width, height, format);
+    }
+    frameInfoPtr = writeChannel<FrameInfo>("IMAGE_INFO");
+
+    // remap table for lens undistortion, computed once
+    if(config().get<bool>("undistort", false)) {
+        if(bayer || captureFormat == V4L2_PIX_FMT_MJPEG) {
+            logger.error("init") << "Undistortion needs an uncompressed capture format";
+            return false;
+        }
+
+        CameraCalibration calib;
+        if(! calib.fromConfig(config())) {
+            logger.error("init") << "Undistortion needs cameraFx, cameraFy, cameraCx and cameraCy";
+            return false;
+        }
+        if(! undistortMap.init(calib, width, height, format)) {
+            logger.error("init") << "Cannot undistort format " << format;
+            return false;
+        }
+    }
+
+    // memory backing of the frame buffers owned or written by the module
+    if(! hugePagesFromString(config().get<std::string>("hugePages", "none"), hugePages)) {
+        logger.error("init") << "hugePages must be none, transparent or explicit";
+        return false;
+    }
+    captureCpu = config().get<int>("captureCpu", -1);
+    if(captureCpu >= int(std::thread::hardware_concurrency())) {
+        logger.error("init") << "captureCpu is " << captureCpu << ", there are only "
+                             << std::thread::hardware_concurrency() << " CPUs";
+        return false;
+    }
+    if(captureCpu >= 0 && ! hasMultipleNumaNodes()) {
+        logger.warn("init") << "captureCpu has no effect on a single NUMA node";
+    }
+
+    // buffers written every frame, the MJPEG decode buffers are handled by
+    // the decoder's FramePool
+    std::vector<lms::imaging::Image*> frameBuffers;
+    frameBuffers.push_back(&*cameraImagePtr);
+    if(changeDetection != ChangeDetection::NONE) {
+        frameBuffers.push_back(&reference);
+    }
+    for(lms::WriteDataChannel<lms::imaging::Image> &level : pyramidImages) {
+        frameBuffers.push_back(&*level);
+    }
+
+    // images allocate their own memory, advise it before the first capture
+    // touches it; this only covers frames larger than a few MiB
+    bool advised = false;
+    if(hugePages != HugePages::NONE) {
+        for(lms::imaging::Image *image : frameBuffers) {
+            advised = adviseHugePages(image->data(), image->size()) || advised;
+        }
+        if(! advised && captureFormat != V4L2_PIX_FMT_MJPEG) {
+            logger.warn("init") << "hugePages has no effect, the frames are too small";
+        }
+    }
+
+    // place the pages near the capture CPU as long as nothing wrote them yet
+    if(captureCpu >= 0) {
+        for(lms::imaging::Image *image : frameBuffers) {
+            touchPages(image->data(), image->size(), captureCpu);
+        }
+    }
+
     // init wrapper
     wrapper = new V4L2Wrapper(logger);
 
+    if(config().get<bool>("asyncInit", false)) {
+        // other modules (e.g. further cameras) initialize meanwhile,
+        // the first cycle waits for the device
+        setupResult = std::async(std::launch::async, &CameraImporter::setupDevice, this);
+        setupPending = true;
+        return true;
+    }
+
+    return setupDevice();
+}
+
+bool CameraImporter::setupDevice() {
+    // opt-in, the driver must allow ioctls from two threads on one fd
+    const bool overlap = config().get<bool>("overlapInit", false);
+    std::vector<std::pair<std::string, lms::Time>> timings;
+    lms::Time stepStart = lms::Time::now();
+    lms::Time setupStart = stepStart;
+    auto step = [&](const std::string &name) {
+        lms::Time now = lms::Time::now();
+        timings.emplace_back(name, now - stepStart);
+        stepStart = now;
+    };
+
     logger.debug("init") << "Opening " << file << " ...";
     if(! wrapper->openDevice(file)) {
         return false;
     }
+    step("open");
 
+    // enumerating is read-only and can run while the format is set
     std::vector<V4L2Wrapper::CameraResolution> resolutions;
-    wrapper->getSupportedResolutions(resolutions);
+    lms::Time enumTime;
+    auto enumerate = [&] {
+        lms::Time start = lms::Time::now();
+        wrapper->getSupportedResolutions(resolutions);
+        enumTime = lms::Time::now() - start;
+    };
+    std::thread enumThread;
+    if(overlap) {
+        enumThread = std::thread(enumerate);
+    } else {
+        enumerate();
+        step("enumerate");
+    }
+
+    logger.debug("init") << "Setting format " << captureWidth << "x" << captureHeight << " ...";
+    bool formatOk = wrapper->setFormat(captureWidth, captureHeight, captureFormat);
+
+    if(formatOk) {
+        logger.debug("init") << "Setting FPS " << framerate << " ...";
+        formatOk = wrapper->setFramerate(framerate);
+    }
+
+    if(overlap) {
+        enumThread.join();
+        timings.emplace_back("enumerate (overlapped)", enumTime);
+    }
+    step("format");
+
     for(const V4L2Wrapper::CameraResolution &res: resolutions) {
         logger.debug("cam") << res.pixelFormat << " "
                             << res.width << "x" << res.height << " " << res.framerate << " FPS";
     }
 
-    logger.debug("init") << "Setting format " << width << "x" << height << " ...";
-    if(! wrapper->setFormat(width, height, format)) {
-        return false;
-    }
-
-    logger.debug("init") << "Setting FPS " << framerate << " ...";
-    if(! wrapper->setFramerate(framerate)) {
+    if(! formatOk) {
         return false;
     }
 
     logger.debug("init") << "Try getFramerate";
     logger.debug("init") << "FPS: " << wrapper->getFramerate();
 
-    wrapper->initBuffersIfNecessary();
+    // controls and streaming buffers are independent in the driver
+    lms::Time controlTime;
+    auto setControls = [&] {
+        lms::Time start = lms::Time::now();
+        wrapper->queryCameraControls();
+        wrapper->setCameraSettings(&config());
+        wrapper->queryCameraControls(); // Re-read current controls
+        controlTime = lms::Time::now() - start;
+    };
+    std::thread controlThread;
+    if(overlap) {
+        controlThread = std::thread(setControls);
+    }
+
+    bool buffersOk = wrapper->initBuffersIfNecessary();
+
+    if(overlap) {
+        controlThread.join();
+        timings.emplace_back("controls (overlapped)", controlTime);
+    } else {
+        step("buffers");
+        setControls();
+    }
+    step(overlap ? "buffers+controls" : "controls");
+
+    if(! buffersOk) {
+        return false;
+    }
 
     logger.info("camera was set up!");
-    
-    // Set camera settings
 
-    wrapper->queryCameraControls();
-    wrapper->setCameraSettings(&config());
-    wrapper->queryCameraControls(); // Re-read current controls
     wrapper->printCameraControls();
 
+    if(captureFormat == V4L2_PIX_FMT_MJPEG) {
+        mjpeg = new MjpegDecoder(logger, *wrapper, *workers);
+        if(! mjpeg->init(cameraImagePtr->width(), cameraImagePtr->height(),
+                         cameraImagePtr->format(), mjpegScale, hugePages, captureCpu)) {
+            return false;
+        }
+    }
+
+    if(config().get<bool>("autoExposure", false)) {
+        autoExposure = new AutoExposure(logger, *wrapper);
+        if(! autoExposure->configure(config())) {
+            return false;
+        }
+    }
+    step("finish");
+
     logger.info() << "After query and set!!";
 
+    for(const std::pair<std::string, lms::Time> &timing : timings) {
+        logger.info("initTime") << file << " " << timing.first << ": " << timing.second;
+    }
+    logger.info("initTime") << file << " total: " << lms::Time::now() - setupStart;
+
 	return true;
 }
 
 bool CameraImporter::deinitialize() {
     logger.info("deinit") << "Deinit: CameraImporter";
+    if(setupPending) {
+        setupResult.wait();
+        setupPending = false;
+    }
+
 	//Stop Camera
-    wrapper->closeDevice();
+    delete mjpeg;
+    delete autoExposure;
+    if(wrapper != nullptr) {
+        wrapper->closeDevice();
+    }
+    delete workers;
     delete wrapper;
 
 	return true;
 }
 
 bool CameraImporter::cycle () {
+    if(setupPending) {
+        setupPending = false;
+        if(! setupResult.get()) {
+            logger.error("cycle") << "Could not set up " << file;
+            setupFailed = true;
+        }
+    }
+
+    // same as a failed initialize() in the synchronous case
+    if(setupFailed) {
+        return false;
+    }
+
     if (! wrapper->isOpen()) {
         logger.error("cycle") << "fd_camera is NULL";
         return false;
@@ -98,6 +395,13 @@ bool CameraImporter::cycle () {
     //TODO Nicht so geil
     if(!valid) {
         logger.error("Camera Importer: Camera handle not valid!\n");
+        if(autoExposure != nullptr) {
+            autoExposure->flush();
+        }
+        // workers may still decode from the mmap buffers closeDevice() unmaps
+        if(mjpeg != nullptr) {
+            mjpeg->flush();
+        }
         while(!valid) {
             wrapper->closeDevice();
             // TODO set format and FPS
@@ -112,13 +416,181 @@ bool CameraImporter::cycle () {
         wrapper->setCameraSettings(&config());
         wrapper->queryCameraControls(); // Re-read current controls
         wrapper->printCameraControls();
+        if(autoExposure != nullptr) {
+            autoExposure->reset();
+        }
         return false;
     }
 
+    // FLAG mode: move the last new frame out of the capture target
+    const bool swapped = referenceInImage;
+    if(swapped) {
+        std::swap(*cameraImagePtr, reference);
+        referenceInImage = false;
+    }
+
+    lms::imaging::Image &captured = changeDetection == ChangeDetection::SUPPRESS
+            ? reference : *cameraImagePtr;
+
     logger.time("read");
-    if(! wrapper->captureImage(*cameraImagePtr)) {
+    bool ok = captureFrame(captured);
+    logger.timeEnd("read");
+
+    if(! ok) {
         logger.error("cycle") << "Could not read a full image";
+        if(swapped) {
+            // keep the last published frame in IMAGE
+            std::swap(*cameraImagePtr, reference);
+            referenceInImage = true;
+        }
+        return false;
+    }
+
+    if(publishFrame(captured)) {
+        for(lms::WriteDataChannel<LazyImage> &derived : derivedImages) {
+            derived->invalidate();
+        }
+
+        // in SUPPRESS mode the levels must match IMAGE, not the staging frame
+        if(changeDetection == ChangeDetection::SUPPRESS) {
+            pyramid.build(*cameraImagePtr);
+        }
+    }
+
+    if(autoExposure != nullptr) {
+        autoExposure->update(*statisticsPtr);
     }
-    logger.timeEnd("read");
 	return true;
 }
+
+bool CameraImporter::captureFrame(lms::imaging::Image &target) {
+    FrameStatistics *stats = statistics ? &*statisticsPtr : nullptr;
+    const bool buildPyramid = ! pyramid.empty()
+            && changeDetection != ChangeDetection::SUPPRESS;
+
+    if(mjpeg != nullptr) {
+        if(! mjpeg->capture(target, captureTimestamp)) {
+            return false;
+        }
+
+        if(stats != nullptr) {
+            copyWithStatistics(nullptr, target.data(), target.width(), target.height(),
+                               target.format(), *stats);
+        }
+        if(buildPyramid) {
+            pyramid.build(target);
+        }
+        return true;
+    }
+
+    if(undistortMap.empty() && ! bayer && ! buildPyramid) {
+        bool ok = wrapper->captureImage(target, stats);
+        captureTimestamp = wrapper->lastTimestamp();
+        return ok;
+    }
+
+    V4L2Wrapper::Frame frame;
+    if(! wrapper->dequeueFrame(frame)) {
+        return false;
+    }
+    captureTimestamp = frame.timestamp;
+
+    const std::size_t frameSize = bayer ? captureWidth * captureHeight : target.size();
+    if(frame.bytesused < frameSize) {
+        wrapper->requeueFrame(frame);
+        return false;
+    }
+
+    if(undistortMap.empty() && ! bayer) {
+        // plain copy, reduce each block into the pyramid while it is in cache
+        const int blockRows = 16;
+        if(stats != nullptr) {
+            stats->reset();
+        }
+        for(int y = 0; y < target.height(); y += blockRows) {
+            int rowEnd = std::min(target.height(), y + blockRows);
+            if(stats != nullptr) {
+                copyRowsWithStatistics(target.data(), frame.data, target.width(), y, rowEnd,
+                                       target.format(), *stats);
+            } else {
+                int rowBytes = target.size() / target.height();
+                memcpy(target.data() + y * rowBytes, frame.data + y * rowBytes,
+                       (rowEnd - y) * rowBytes);
+            }
+            pyramid.reduceRows(target, y, rowEnd);
+        }
+        pyramid.finish();
+
+        return wrapper->requeueFrame(frame);
+    }
+
+    // the processed image is the only copy written
+    const int bandRows = (target.height() + captureBands - 1) / captureBands;
+    workers->parallelFor(captureBands, [&](int band) {
+        int rowBegin = band * bandRows, rowEnd = (band + 1) * bandRows;
+        if(bayerBinning) {
+            demosaicBinned(frame.data, captureWidth, captureHeight, bayerPattern,
+                           target.data(), target.format(), rowBegin, rowEnd);
+        } else if(bayer) {
+            demosaic(frame.data, captureWidth, captureHeight, bayerPattern,
+                     target.data(), target.format(), rowBegin, rowEnd);
+        } else {
+            undistortMap.apply(frame.data, target.data(), rowBegin, rowEnd);
+        }
+    });
+
+    if(! wrapper->requeueFrame(frame)) {
+        return false;
+    }
+
+    if(stats != nullptr) {
+        copyWithStatistics(nullptr, target.data(), target.width(), target.height(),
+                           target.format(), *stats);
+    }
+    if(buildPyramid) {
+        pyramid.build(target);
+    }
+
+    return true;
+}
+
+bool CameraImporter::publishFrame(lms::imaging::Image &captured) {
+    FrameInfo &info = *frameInfoPtr;
+
+    bool isNew = true;
+    if(changeDetection != ChangeDetection::NONE && info.sequence > 0
+            && int(info.skipped) < maxSkippedFrames) {
+        // in SUPPRESS mode IMAGE still holds the last published frame
+        isNew = changeDetector.changed(captured, changeDetection == ChangeDetection::SUPPRESS
+                                       ? *cameraImagePtr : reference);
+    }
+
+    info.duplicate = ! isNew;
+
+    // in SUPPRESS mode IMAGE and its timestamp stay at the last new frame
+    if(isNew || changeDetection != ChangeDetection::SUPPRESS) {
+        info.timestamp = captureTimestamp;
+    }
+
+    if(! isNew) {
+        info.skipped++;
+        return false;
+    }
+
+    // swap buffers instead of copying the frame
+    switch(changeDetection) {
+    case ChangeDetection::FLAG:
+        // IMAGE is the reference until the next cycle swaps it out
+        referenceInImage = true;
+        break;
+    case ChangeDetection::SUPPRESS:
+        std::swap(*cameraImagePtr, reference);
+        break;
+    case ChangeDetection::NONE:
+        break;
+    }
+
+    info.sequence++;
+    info.skipped = 0;
+    return true;
+}
@@ -0,0 +1,111 @@
+#include "change_detector.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Sampled rows per block, a block covers BLOCK_ROWS * gridStep rows.
+ */
+const int BLOCK_ROWS = 8;
+
+/**
+ * @brief Minimum block width in bytes, a multiple of the SSE2 register.
+ */
+const int BLOCK_BYTES = 32;
+
+/**
+ * @brief Sum of absolute differences of n bytes.
+ */
+std::uint32_t sad(const std::uint8_t *a, const std::uint8_t *b, int n) {
+    std::uint32_t sum = 0;
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128i acc = _mm_setzero_si128();
+    for(; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    sum = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+
+    for(; i < n; i++) {
+        sum += std::abs(int(a[i]) - int(b[i]));
+    }
+    return sum;
+}
+
+}  // namespace
+
+ChangeDetector::ChangeDetector() : gridStep(2), threshold(6), difference(0) {
+}
+
+void ChangeDetector::configure(int gridStep, float threshold) {
+    this->gridStep = std::max(1, gridStep);
+    this->threshold = threshold;
+}
+
+bool ChangeDetector::changed(const lms::imaging::Image &frame,
+                             const lms::imaging::Image &reference) {
+    if(frame.width() != reference.width() || frame.height() != reference.height()
+            || frame.format() != reference.format() || frame.size() != reference.size()) {
+        difference = 255;
+        return true;
+    }
+
+    difference = 0;
+    if(frame.width() == 0 || frame.height() == 0) {
+        return false;
+    }
+
+    const int rowBytes = frame.size() / frame.height();
+    const int bpp = std::max(1, rowBytes / frame.width());
+    // roughly square blocks, rounded up to whole 16 byte segments
+    const int blockRows = BLOCK_ROWS * gridStep;
+    const int blockBytes = std::max(BLOCK_BYTES, (blockRows * bpp + 15) / 16 * 16);
+    const int blocksX = (rowBytes + blockBytes - 1) / blockBytes;
+
+    // only allocates when the frame width changes
+    blockSad.resize(blocksX);
+    blockSamples.resize(blocksX);
+
+    for(int by = 0; by < frame.height(); by += blockRows) {
+        std::fill(blockSad.begin(), blockSad.end(), 0);
+        std::fill(blockSamples.begin(), blockSamples.end(), 0);
+
+        const int yEnd = std::min(frame.height(), by + blockRows);
+        for(int y = by; y < yEnd; y += gridStep) {
+            const std::uint8_t *a = frame.data() + y * rowBytes;
+            const std::uint8_t *b = reference.data() + y * rowBytes;
+
+            for(int bx = 0; bx < blocksX; bx++) {
+                const int begin = bx * blockBytes;
+                const int bytes = std::min(rowBytes, begin + blockBytes) - begin;
+                blockSad[bx] += sad(a + begin, b + begin, bytes);
+                blockSamples[bx] += bytes;
+            }
+        }
+
+        for(int bx = 0; bx < blocksX; bx++) {
+            difference = std::max(difference, float(blockSad[bx]) / blockSamples[bx]);
+        }
+
+        // a single changed block is enough, skip the rest of the frame
+        if(difference > threshold) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+float ChangeDetector::lastDifference() const {
+    return difference;
+}
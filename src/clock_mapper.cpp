@@ -0,0 +1,113 @@
+#include "clock_mapper.h"
+
+#include <limits>
+
+namespace {
+
+// time between two samples and number of samples in the fit window
+const std::int64_t SAMPLE_INTERVAL = 500 * 1000;
+const std::size_t WINDOW = 64;
+const int ATTEMPTS = 3;
+
+}  // namespace
+
+ClockMapper::ClockMapper(clockid_t clock) {
+    setClock(clock);
+}
+
+void ClockMapper::setClock(clockid_t clock) {
+    sourceClock = clock;
+    samples.clear();
+    lastSample = 0;
+    baseOffset = 0;
+    reference = 0;
+    intercept = 0;
+    slope = 0;
+}
+
+clockid_t ClockMapper::clock() const {
+    return sourceClock;
+}
+
+std::int64_t ClockMapper::now(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return std::int64_t(ts.tv_sec) * 1000 * 1000 + ts.tv_nsec / 1000;
+}
+
+void ClockMapper::update() {
+    std::int64_t source = now(sourceClock);
+    // lastSample is only valid once there is a sample
+    if(! samples.empty() && source - lastSample < SAMPLE_INTERVAL) {
+        return;
+    }
+
+    Sample best;
+    std::int64_t bestWidth = std::numeric_limits<std::int64_t>::max();
+    for(int i = 0; i < ATTEMPTS; i++) {
+        std::int64_t before = lms::Time::now().micros();
+        source = now(sourceClock);
+        std::int64_t after = lms::Time::now().micros();
+
+        if(after - before < bestWidth) {
+            bestWidth = after - before;
+            best.source = source;
+            best.offset = before + (after - before) / 2.0 - source;
+        }
+    }
+
+    // keep the regression sums small, the clocks may be decades apart
+    if(samples.empty()) {
+        baseOffset = static_cast<std::int64_t>(best.offset);
+    }
+    best.offset -= baseOffset;
+
+    lastSample = best.source;
+    samples.push_back(best);
+    if(samples.size() > WINDOW) {
+        samples.pop_front();
+    }
+
+    fit();
+}
+
+void ClockMapper::fit() {
+    reference = samples.back().source;
+
+    if(samples.size() < 2) {
+        intercept = samples.back().offset;
+        slope = 0;
+        return;
+    }
+
+    // least squares over the window, x relative to the newest sample
+    double n = samples.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for(const Sample &s : samples) {
+        double x = s.source - reference;
+        sx += x;
+        sy += s.offset;
+        sxx += x * x;
+        sxy += x * s.offset;
+    }
+
+    double denom = n * sxx - sx * sx;
+    slope = denom > 0 ? (n * sxy - sx * sy) / denom : 0;
+    intercept = (sy - slope * sx) / n;
+}
+
+lms::Time ClockMapper::map(std::int64_t sourceMicros) {
+    if(samples.empty()) {
+        update();
+    }
+
+    double off = intercept + slope * (sourceMicros - reference);
+    return lms::Time::fromMicros(sourceMicros + baseOffset + static_cast<std::int64_t>(off));
+}
+
+double ClockMapper::offset() const {
+    return baseOffset + intercept;
+}
+
+double ClockMapper::driftPpm() const {
+    return slope * 1e6;
+}
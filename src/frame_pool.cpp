@@ -0,0 +1,141 @@
+#include "frame_pool.h"
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <thread>
+
+namespace {
+
+const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+const std::size_t CACHE_LINE = 64;
+
+std::size_t roundUp(std::size_t value, std::size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+/**
+ * @brief Write every page once so it is faulted in now and not during
+ * capture, keeps the content.
+ */
+void touch(std::uint8_t *memory, std::size_t size) {
+    volatile std::uint8_t *pages = memory;
+    const std::size_t page = sysconf(_SC_PAGESIZE);
+    for(std::size_t i = 0; i < size; i += page) {
+        pages[i] = pages[i];
+    }
+}
+
+}  // namespace
+
+bool hugePagesFromString(const std::string &name, HugePages &mode) {
+    if(name == "none") {
+        mode = HugePages::NONE;
+    } else if(name == "transparent") {
+        mode = HugePages::TRANSPARENT;
+    } else if(name == "explicit") {
+        mode = HugePages::EXPLICIT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool adviseHugePages(void *data, std::size_t size) {
+#ifdef MADV_HUGEPAGE
+    std::uintptr_t begin = roundUp(reinterpret_cast<std::uintptr_t>(data), HUGE_PAGE_SIZE);
+    std::uintptr_t end = (reinterpret_cast<std::uintptr_t>(data) + size) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    if(end > begin) {
+        return madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE) == 0;
+    }
+#else
+    (void)data;
+    (void)size;
+#endif
+    return false;
+}
+
+void touchPages(void *data, std::size_t size, int cpu) {
+    std::uint8_t *memory = static_cast<std::uint8_t*>(data);
+    if(cpu < 0) {
+        touch(memory, size);
+        return;
+    }
+
+    std::thread toucher([memory, size, cpu] {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+        touch(memory, size);
+    });
+    toucher.join();
+}
+
+bool hasMultipleNumaNodes() {
+    // e.g. "0" on a single node, "0-1" or "0,2" otherwise
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string nodes;
+    if(! std::getline(online, nodes)) {
+        return false;
+    }
+    return nodes.find_first_of("-,") != std::string::npos;
+}
+
+FramePool::FramePool() : memory(nullptr), mappedSize(0), stride(0) {
+}
+
+FramePool::~FramePool() {
+    destroy();
+}
+
+void FramePool::destroy() {
+    if(memory != nullptr) {
+        munmap(memory, mappedSize);
+        memory = nullptr;
+    }
+}
+
+bool FramePool::init(std::size_t count, std::size_t size, HugePages mode, int cpu) {
+    destroy();
+
+    stride = roundUp(size, CACHE_LINE);
+
+    void *mapped = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if(mode == HugePages::EXPLICIT) {
+        mappedSize = roundUp(stride * count, HUGE_PAGE_SIZE);
+        mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if(mapped == MAP_FAILED) {
+        if(mode == HugePages::EXPLICIT) {
+            // no reserved huge pages, let the kernel try transparent ones
+            mode = HugePages::TRANSPARENT;
+        }
+        mappedSize = roundUp(stride * count, mode == HugePages::NONE
+                             ? sysconf(_SC_PAGESIZE) : HUGE_PAGE_SIZE);
+        mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mapped == MAP_FAILED) {
+            mappedSize = 0;
+            return false;
+        }
+        if(mode == HugePages::TRANSPARENT) {
+            adviseHugePages(mapped, mappedSize);
+        }
+    }
+    memory = static_cast<std::uint8_t*>(mapped);
+
+    // fault the pages in on the capture CPU's NUMA node
+    touchPages(memory, mappedSize, cpu);
+
+    return true;
+}
+
+std::uint8_t* FramePool::buffer(std::size_t index) {
+    return memory + index * stride;
+}
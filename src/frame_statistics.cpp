@@ -0,0 +1,174 @@
+#include "frame_statistics.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Copy one row and accumulate its sum, dark and saturated counts.
+ * @param dst destination row or nullptr
+ * @param stride 1 for GREY, 2 for YUYV (luma on every even byte)
+ */
+void copyRowWithStatistics(std::uint8_t *dst, const std::uint8_t *row, int rowBytes,
+                           int stride, FrameStatistics &stats) {
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lumaMask = stride == 2 ? _mm_set1_epi16(0x00FF) : _mm_set1_epi8(-1);
+    const int bitMask = stride == 2 ? 0x5555 : 0xFFFF;
+    const __m128i darkLevel = _mm_set1_epi8(static_cast<char>(stats.darkLevel));
+    const __m128i saturationLevel = _mm_set1_epi8(static_cast<char>(stats.saturationLevel));
+    __m128i sum = _mm_setzero_si128();
+
+    for(; i + 16 <= rowBytes; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        if(dst != nullptr) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        }
+
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_and_si128(v, lumaMask), zero));
+
+        // v <= dark  <=>  min(v, dark) == v
+        int darkBits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, darkLevel), v));
+        // v >= saturation  <=>  max(v, saturation) == v
+        int satBits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, saturationLevel), v));
+
+        stats.dark += __builtin_popcount(darkBits & bitMask);
+        stats.saturated += __builtin_popcount(satBits & bitMask);
+    }
+
+    std::uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+    stats.lumaSum += lanes[0] + lanes[1];
+#endif
+
+    if(dst != nullptr) {
+        memcpy(dst + i, row + i, rowBytes - i);
+    }
+
+    for(; i < rowBytes; i += stride) {
+        std::uint8_t y = row[i];
+        stats.lumaSum += y;
+        stats.dark += y <= stats.darkLevel;
+        stats.saturated += y >= stats.saturationLevel;
+    }
+
+    stats.pixels += rowBytes / stride;
+}
+
+/**
+ * @brief RGB version of copyRowWithStatistics(), also fills the histogram
+ * with every step-th pixel.
+ */
+void copyRGBRowWithStatistics(std::uint8_t *dst, const std::uint8_t *row, int width,
+                              int step, FrameStatistics &stats) {
+    if(dst != nullptr) {
+        memcpy(dst, row, width * 3);
+    }
+
+    for(int x = 0; x < width; x++) {
+        const std::uint8_t *p = row + 3 * x;
+        int y = (p[0] + 2 * p[1] + p[2] + 2) >> 2;
+        stats.lumaSum += y;
+        stats.dark += y <= stats.darkLevel;
+        stats.saturated += y >= stats.saturationLevel;
+
+        if(x % step == 0) {
+            stats.histogram[y]++;
+            stats.histogramSamples++;
+        }
+    }
+
+    stats.pixels += width;
+}
+
+}  // namespace
+
+FrameStatistics::FrameStatistics() : gridStep(4), darkLevel(5), saturationLevel(250) {
+    reset();
+}
+
+void FrameStatistics::reset() {
+    pixels = 0;
+    lumaSum = 0;
+    dark = 0;
+    saturated = 0;
+    histogramSamples = 0;
+    histogram.fill(0);
+}
+
+float FrameStatistics::meanBrightness() const {
+    return pixels == 0 ? 0 : float(lumaSum) / pixels;
+}
+
+float FrameStatistics::darkRatio() const {
+    return pixels == 0 ? 0 : float(dark) / pixels;
+}
+
+float FrameStatistics::saturatedRatio() const {
+    return pixels == 0 ? 0 : float(saturated) / pixels;
+}
+
+void copyWithStatistics(std::uint8_t *dst, const std::uint8_t *src,
+                        int width, int height, lms::imaging::Format fmt,
+                        FrameStatistics &stats) {
+    stats.reset();
+    copyRowsWithStatistics(dst, src, width, 0, height, fmt, stats);
+}
+
+void copyRowsWithStatistics(std::uint8_t *dst, const std::uint8_t *src,
+                            int width, int rowBegin, int rowEnd, lms::imaging::Format fmt,
+                            FrameStatistics &stats) {
+    using lms::imaging::Format;
+
+    const int rowBytes = width * lms::imaging::bytesPerPixel(fmt);
+    int stride = 0;
+    if(fmt == Format::GREY) {
+        stride = 1;
+    } else if(fmt == Format::YUYV) {
+        stride = 2;
+    } else if(fmt == Format::RGB) {
+        stride = 3;
+    }
+
+    if(stride == 0) {
+        if(dst != nullptr) {
+            memcpy(dst + rowBegin * rowBytes, src + rowBegin * rowBytes,
+                   rowBytes * (rowEnd - rowBegin));
+        }
+        return;
+    }
+
+    const int step = std::max(1, stats.gridStep);
+
+    for(int y = rowBegin; y < rowEnd; y++) {
+        const std::uint8_t *srcRow = src + y * rowBytes;
+        std::uint8_t *dstRow = dst == nullptr ? nullptr : dst + y * rowBytes;
+
+        if(y % step != 0) {
+            if(dstRow != nullptr) {
+                memcpy(dstRow, srcRow, rowBytes);
+            }
+            continue;
+        }
+
+        if(stride == 3) {
+            copyRGBRowWithStatistics(dstRow, srcRow, width, step, stats);
+            continue;
+        }
+
+        copyRowWithStatistics(dstRow, srcRow, rowBytes, stride, stats);
+
+        // the row was just loaded by the copy and is still in cache
+        for(int x = 0; x < rowBytes; x += step * stride) {
+            stats.histogram[srcRow[x]]++;
+            stats.histogramSamples++;
+        }
+    }
+}
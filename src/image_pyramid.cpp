@@ -0,0 +1,133 @@
+#include "image_pyramid.h"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Same as reduceGreyRows() for the luma channel of YUYV rows.
+ */
+void reduceYUYVRows(const std::uint8_t *row0, const std::uint8_t *row1,
+                    std::uint8_t *out, int outWidth) {
+    int x = 0;
+
+#ifdef __SSE2__
+    const __m128i low = _mm_set1_epi16(0x00FF);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi32(2);
+
+    // 16 bytes hold 8 luma samples -> 4 output pixels
+    for(; x + 8 <= outWidth; x += 8) {
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 4 * x));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 4 * x));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 4 * x + 16));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 4 * x + 16));
+
+        __m128i s0 = _mm_madd_epi16(_mm_add_epi16(_mm_and_si128(a0, low), _mm_and_si128(b0, low)), ones);
+        __m128i s1 = _mm_madd_epi16(_mm_add_epi16(_mm_and_si128(a1, low), _mm_and_si128(b1, low)), ones);
+        s0 = _mm_srli_epi32(_mm_add_epi32(s0, two), 2);
+        s1 = _mm_srli_epi32(_mm_add_epi32(s1, two), 2);
+
+        __m128i res = _mm_packs_epi32(s0, s1);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(res, res));
+    }
+#endif
+
+    for(; x < outWidth; x++) {
+        out[x] = (row0[4 * x] + row0[4 * x + 2] + row1[4 * x] + row1[4 * x + 2] + 2) >> 2;
+    }
+}
+
+/**
+ * @brief RGB to grey with (R + 2G + B) / 4 averaged over the 2x2 block.
+ */
+void reduceRGBRows(const std::uint8_t *row0, const std::uint8_t *row1,
+                   std::uint8_t *out, int outWidth) {
+    for(int x = 0; x < outWidth; x++) {
+        int sum = 0;
+        for(const std::uint8_t *p : { row0 + 6 * x, row0 + 6 * x + 3, row1 + 6 * x, row1 + 6 * x + 3 }) {
+            sum += p[0] + 2 * p[1] + p[2];
+        }
+        out[x] = (sum + 8) >> 4;
+    }
+}
+
+}  // namespace
+
+void reduceGreyRows(const std::uint8_t *row0, const std::uint8_t *row1,
+                    std::uint8_t *out, int outWidth) {
+    int x = 0;
+
+#ifdef __SSE2__
+    const __m128i low = _mm_set1_epi16(0x00FF);
+    const __m128i two = _mm_set1_epi16(2);
+    for(; x + 8 <= outWidth; x += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * x));
+        // sum of each 2x2 block in 16 bit lanes
+        __m128i sum = _mm_add_epi16(
+                    _mm_add_epi16(_mm_and_si128(a, low), _mm_srli_epi16(a, 8)),
+                    _mm_add_epi16(_mm_and_si128(b, low), _mm_srli_epi16(b, 8)));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(sum, sum));
+    }
+#endif
+
+    for(; x < outWidth; x++) {
+        out[x] = (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2;
+    }
+}
+
+void ImagePyramid::setLevels(const std::vector<lms::imaging::Image*> &levels) {
+    this->levels = levels;
+}
+
+bool ImagePyramid::empty() const {
+    return levels.empty();
+}
+
+void ImagePyramid::reduceRows(const lms::imaging::Image &frame, int rowBegin, int rowEnd) {
+    using lms::imaging::Format;
+
+    if(levels.empty() || frame.height() == 0) {
+        return;
+    }
+
+    lms::imaging::Image &level = *levels[0];
+    const int rowBytes = frame.size() / frame.height();
+    const int outEnd = std::min(level.height(), rowEnd / 2);
+
+    for(int y = rowBegin / 2; y < outEnd; y++) {
+        const std::uint8_t *row0 = frame.data() + 2 * y * rowBytes;
+        const std::uint8_t *row1 = row0 + rowBytes;
+        std::uint8_t *out = level.data() + y * level.width();
+
+        switch(frame.format()) {
+        case Format::GREY: reduceGreyRows(row0, row1, out, level.width()); break;
+        case Format::YUYV: reduceYUYVRows(row0, row1, out, level.width()); break;
+        case Format::RGB: reduceRGBRows(row0, row1, out, level.width()); break;
+        default: break;
+        }
+    }
+}
+
+void ImagePyramid::finish() {
+    for(std::size_t i = 1; i < levels.size(); i++) {
+        const lms::imaging::Image &src = *levels[i - 1];
+        lms::imaging::Image &dst = *levels[i];
+
+        for(int y = 0; y < dst.height(); y++) {
+            const std::uint8_t *row0 = src.data() + 2 * y * src.width();
+            reduceGreyRows(row0, row0 + src.width(), dst.data() + y * dst.width(), dst.width());
+        }
+    }
+}
+
+void ImagePyramid::build(const lms::imaging::Image &frame) {
+    reduceRows(frame, 0, frame.height());
+    finish();
+}
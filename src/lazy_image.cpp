@@ -0,0 +1,88 @@
+#include "lazy_image.h"
+#include "lms/imaging/converter.h"
+
+#include <cstring>
+
+LazyImage::LazyImage() : source(nullptr), targetFormat(lms::imaging::Format::UNKNOWN),
+    logger(nullptr), frame(1), convertedFrame(0), numConversions(0), failed(false) {
+}
+
+LazyImage::LazyImage(const LazyImage &obj) : LazyImage() {
+    *this = obj;
+}
+
+LazyImage& LazyImage::operator = (const LazyImage &obj) {
+    if(this == &obj) {
+        return *this;
+    }
+
+    std::lock(mutex, obj.mutex);
+    std::lock_guard<std::mutex> lockThis(mutex, std::adopt_lock);
+    std::lock_guard<std::mutex> lockOther(obj.mutex, std::adopt_lock);
+
+    source = obj.source;
+    targetFormat = obj.targetFormat;
+    logger = obj.logger;
+    frame = obj.frame;
+    convertedFrame = obj.convertedFrame;
+    numConversions = obj.numConversions;
+    failed = obj.failed;
+    cache = obj.cache;
+
+    return *this;
+}
+
+void LazyImage::setSource(const lms::imaging::Image *source, lms::imaging::Format format,
+                          lms::logging::Logger *logger) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->source = source;
+    targetFormat = format;
+    this->logger = logger;
+    frame++;
+}
+
+void LazyImage::invalidate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    frame++;
+}
+
+const lms::imaging::Image& LazyImage::get() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if(convertedFrame != frame && source != nullptr) {
+        if(source->format() == targetFormat) {
+            // reuses the cache buffer once it has the right size
+            cache.resize(source->width(), source->height(), targetFormat);
+            memcpy(cache.data(), source->data(), source->size());
+        } else if(! lms::imaging::convert(*source, cache, targetFormat)) {
+            // never hand out a stale frame, report once per failing streak
+            cache.resize(0, 0, targetFormat);
+            if(! failed && logger != nullptr) {
+                logger->error("LazyImage") << "Cannot convert " << source->format()
+                                           << " to " << targetFormat;
+            }
+            failed = true;
+            convertedFrame = frame;
+            return cache;
+        }
+        failed = false;
+        convertedFrame = frame;
+        numConversions++;
+    }
+
+    return cache;
+}
+
+bool LazyImage::isConverted() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return convertedFrame == frame;
+}
+
+lms::imaging::Format LazyImage::format() const {
+    return targetFormat;
+}
+
+std::uint64_t LazyImage::conversions() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return numConversions;
+}
@@ -0,0 +1,273 @@
+#include "mjpeg_decoder.h"
+
+#include <cstdio>
+#include <csetjmp>
+#include <cstring>
+
+#ifdef CAMERA_IMPORTER_MJPEG
+#include <jpeglib.h>
+#endif
+
+namespace {
+
+#ifdef CAMERA_IMPORTER_MJPEG
+
+struct ErrorManager {
+    jpeg_error_mgr pub;
+    std::jmp_buf jump;
+};
+
+void onError(j_common_ptr cinfo) {
+    std::longjmp(reinterpret_cast<ErrorManager*>(cinfo->err)->jump, 1);
+}
+
+void onMessage(j_common_ptr, int) {
+    // corrupt data warnings happen on every USB hiccup, ignore them
+}
+
+#endif
+
+}  // namespace
+
+struct MjpegDecoder::Decompressor {
+#ifdef CAMERA_IMPORTER_MJPEG
+    jpeg_decompress_struct cinfo;
+    ErrorManager err;
+#endif
+};
+
+namespace {
+
+#ifdef CAMERA_IMPORTER_MJPEG
+
+/**
+ * @brief Decode one JPEG into a preallocated buffer.
+ *
+ * Plain C style because of setjmp/longjmp error handling. The
+ * decompressor is reused, it is only reset to its initial state.
+ *
+ * @param out width x height pixels in fmt
+ * @param row scratch buffer of at least width * 3 bytes, used for YUYV
+ */
+template<typename Decompressor>
+bool decodeJpeg(Decompressor &jpeg, const std::uint8_t *data, std::size_t size, int scale,
+                int width, int height, lms::imaging::Format fmt,
+                std::uint8_t *out, std::uint8_t *row) {
+    using lms::imaging::Format;
+
+    jpeg_decompress_struct &cinfo = jpeg.cinfo;
+    if(setjmp(jpeg.err.jump)) {
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+
+    // reuses the source manager of the previous frame
+    // libjpeg-turbo falls back to the standard Huffman tables UVC frames omit
+    jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data), size);
+    jpeg_read_header(&cinfo, TRUE);
+
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale;
+    cinfo.dct_method = JDCT_IFAST;
+    cinfo.do_fancy_upsampling = FALSE;
+
+    switch(fmt) {
+    case Format::GREY: cinfo.out_color_space = JCS_GRAYSCALE; break;
+    case Format::RGB: cinfo.out_color_space = JCS_RGB; break;
+    default: cinfo.out_color_space = JCS_YCbCr; break;
+    }
+
+    jpeg_start_decompress(&cinfo);
+
+    if(int(cinfo.output_width) != width || int(cinfo.output_height) != height) {
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+
+    const int rowBytes = width * lms::imaging::bytesPerPixel(fmt);
+
+    while(cinfo.output_scanline < cinfo.output_height) {
+        std::uint8_t *line = out + cinfo.output_scanline * rowBytes;
+
+        if(fmt != Format::YUYV) {
+            JSAMPROW rows[1] = { line };
+            jpeg_read_scanlines(&cinfo, rows, 1);
+            continue;
+        }
+
+        JSAMPROW rows[1] = { row };
+        jpeg_read_scanlines(&cinfo, rows, 1);
+
+        // pack YCbCr 4:4:4 into YUYV 4:2:2
+        for(int x = 0; x + 1 < width; x += 2) {
+            const std::uint8_t *p = row + x * 3;
+            line[x * 2] = p[0];
+            line[x * 2 + 1] = (p[1] + p[4] + 1) >> 1;
+            line[x * 2 + 2] = p[3];
+            line[x * 2 + 3] = (p[2] + p[5] + 1) >> 1;
+        }
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    return true;
+}
+
+#else
+
+template<typename Decompressor>
+bool decodeJpeg(Decompressor &, const std::uint8_t *, std::size_t, int, int, int,
+                lms::imaging::Format, std::uint8_t *, std::uint8_t *) {
+    return false;
+}
+
+#endif
+
+}  // namespace
+
+MjpegDecoder::MjpegDecoder(lms::logging::Logger &logger, V4L2Wrapper &wrapper,
+                           WorkerPool &workers)
+    : logger(logger), wrapper(wrapper), workers(workers),
+      width(0), height(0), format(lms::imaging::Format::UNKNOWN), scale(1), depth(1),
+      head(0), inFlight(0) {
+}
+
+MjpegDecoder::~MjpegDecoder() {
+    flush();
+    destroySlots();
+}
+
+void MjpegDecoder::destroySlots() {
+    for(Slot &slot : slots) {
+#ifdef CAMERA_IMPORTER_MJPEG
+        jpeg_destroy_decompress(&slot.jpeg->cinfo);
+#endif
+        delete slot.jpeg;
+    }
+    slots.clear();
+}
+
+bool MjpegDecoder::isSupported() {
+#ifdef CAMERA_IMPORTER_MJPEG
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool MjpegDecoder::init(int width, int height, lms::imaging::Format fmt, int scale,
+                        HugePages hugePages, int cpu) {
+    using lms::imaging::Format;
+
+    if(! isSupported()) {
+        logger.error("mjpeg") << "Built without libjpeg";
+        return false;
+    }
+    if(fmt != Format::GREY && fmt != Format::YUYV && fmt != Format::RGB) {
+        logger.error("mjpeg") << "Cannot decode to format " << fmt;
+        return false;
+    }
+    if(scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+        logger.error("mjpeg") << "Scale must be 1, 2, 4 or 8, not " << scale;
+        return false;
+    }
+
+    flush();
+
+    this->width = width;
+    this->height = height;
+    format = fmt;
+    this->scale = scale;
+    // read IO dequeues every frame into the same buffer, so only one frame
+    // can be decoded at a time
+    depth = wrapper.isStreaming() ? workers.size() + 1 : 1;
+
+    // one decode target per slot, allocated once here
+    if(! pool.init(depth, width * height * lms::imaging::bytesPerPixel(fmt), hugePages, cpu)) {
+        logger.error("mjpeg") << "Could not allocate decode buffers";
+        return false;
+    }
+
+    destroySlots();
+    slots.resize(depth);
+    for(std::size_t i = 0; i < depth; i++) {
+        slots[i].buffer = pool.buffer(i);
+        slots[i].row.resize(width * 3);
+
+        // created once, libjpeg mallocs its memory pools on every create
+        slots[i].jpeg = new Decompressor;
+#ifdef CAMERA_IMPORTER_MJPEG
+        jpeg_decompress_struct &cinfo = slots[i].jpeg->cinfo;
+        ErrorManager &err = slots[i].jpeg->err;
+        cinfo.err = jpeg_std_error(&err.pub);
+        err.pub.error_exit = onError;
+        err.pub.emit_message = onMessage;
+        jpeg_create_decompress(&cinfo);
+#endif
+    }
+    head = 0;
+
+    return true;
+}
+
+bool MjpegDecoder::submit() {
+    Slot *slot = &slots[(head + inFlight) % depth];
+    if(! wrapper.dequeueFrame(slot->frame)) {
+        return false;
+    }
+
+    slot->done = false;
+    slot->ok = false;
+    inFlight++;
+
+    // two pointers fit into std::function without a heap allocation
+    workers.post([this, slot] {
+        bool ok = decodeJpeg(*slot->jpeg, slot->frame.data, slot->frame.bytesused, scale,
+                             width, height, format, slot->buffer, slot->row.data());
+
+        std::lock_guard<std::mutex> lock(mutex);
+        slot->ok = ok;
+        slot->done = true;
+        cond.notify_all();
+    });
+
+    return true;
+}
+
+bool MjpegDecoder::capture(lms::imaging::Image &image, lms::Time &timestamp) {
+    while(inFlight < depth) {
+        if(! submit()) {
+            return false;
+        }
+    }
+
+    Slot *slot = &slots[head];
+    head = (head + 1) % depth;
+    inFlight--;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [slot] { return slot->done; });
+    }
+
+    timestamp = slot->frame.timestamp;
+    bool ok = wrapper.requeueFrame(slot->frame) && slot->ok;
+    if(slot->ok) {
+        memcpy(image.data(), slot->buffer, image.size());
+    } else {
+        logger.warn("mjpeg") << "Could not decode frame of " << slot->frame.bytesused << " bytes";
+    }
+
+    return ok;
+}
+
+void MjpegDecoder::flush() {
+    while(inFlight > 0) {
+        Slot *slot = &slots[head];
+        head = (head + 1) % depth;
+        inFlight--;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [slot] { return slot->done; });
+        }
+        wrapper.requeueFrame(slot->frame);
+    }
+}
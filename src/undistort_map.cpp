@@ -0,0 +1,246 @@
+#include "undistort_map.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const int WEIGHT_BITS = 7;
+const int WEIGHT_ONE = 1 << WEIGHT_BITS;
+const int WEIGHT_HALF = WEIGHT_ONE / 2;
+
+inline std::uint8_t interpolate(int p00, int p01, int p10, int p11, int wx, int wy) {
+    int top = (p00 * (WEIGHT_ONE - wx) + p01 * wx + WEIGHT_HALF) >> WEIGHT_BITS;
+    int bottom = (p10 * (WEIGHT_ONE - wx) + p11 * wx + WEIGHT_HALF) >> WEIGHT_BITS;
+    return (top * (WEIGHT_ONE - wy) + bottom * wy + WEIGHT_HALF) >> WEIGHT_BITS;
+}
+
+}  // namespace
+
+CameraCalibration::CameraCalibration() : fx(0), fy(0), cx(0), cy(0),
+    k1(0), k2(0), p1(0), p2(0), k3(0) {
+}
+
+bool CameraCalibration::fromConfig(const lms::Config &config) {
+    fx = config.get<double>("cameraFx", 0);
+    fy = config.get<double>("cameraFy", 0);
+    cx = config.get<double>("cameraCx", 0);
+    cy = config.get<double>("cameraCy", 0);
+    k1 = config.get<double>("distK1", 0);
+    k2 = config.get<double>("distK2", 0);
+    p1 = config.get<double>("distP1", 0);
+    p2 = config.get<double>("distP2", 0);
+    k3 = config.get<double>("distK3", 0);
+
+    // a missing principal point would silently remap around pixel (0,0)
+    return fx > 0 && fy > 0 && config.hasKey("cameraCx") && config.hasKey("cameraCy");
+}
+
+UndistortMap::UndistortMap() : w(0), h(0), format(lms::imaging::Format::UNKNOWN) {
+}
+
+bool UndistortMap::init(const CameraCalibration &calib, int width, int height,
+                        lms::imaging::Format fmt) {
+    using lms::imaging::Format;
+
+    if(fmt != Format::GREY && fmt != Format::YUYV && fmt != Format::RGB) {
+        return false;
+    }
+    if(width < 2 || height < 2) {
+        return false;
+    }
+
+    w = width;
+    h = height;
+    format = fmt;
+    offsets.resize(w * h);
+    weightsX.resize(w * h);
+    weightsY.resize(w * h);
+
+    for(int v = 0; v < h; v++) {
+        for(int u = 0; u < w; u++) {
+            // project the ideal pixel through the distortion model
+            double x = (u - calib.cx) / calib.fx;
+            double y = (v - calib.cy) / calib.fy;
+            double r2 = x * x + y * y;
+            double radial = 1 + r2 * (calib.k1 + r2 * (calib.k2 + r2 * calib.k3));
+            double xd = x * radial + 2 * calib.p1 * x * y + calib.p2 * (r2 + 2 * x * x);
+            double yd = y * radial + calib.p1 * (r2 + 2 * y * y) + 2 * calib.p2 * x * y;
+            double su = calib.fx * xd + calib.cx;
+            double sv = calib.fy * yd + calib.cy;
+
+            int i = v * w + u;
+            if(! (su >= 0 && su <= w - 1 && sv >= 0 && sv <= h - 1)) {
+                offsets[i] = -1;
+                weightsX[i] = weightsY[i] = 0;
+                continue;
+            }
+
+            int x0 = std::min(static_cast<int>(su), w - 2);
+            int y0 = std::min(static_cast<int>(sv), h - 2);
+            offsets[i] = y0 * w + x0;
+            weightsX[i] = std::min<int>(WEIGHT_ONE, std::lround((su - x0) * WEIGHT_ONE));
+            weightsY[i] = std::min<int>(WEIGHT_ONE, std::lround((sv - y0) * WEIGHT_ONE));
+        }
+    }
+
+    return true;
+}
+
+bool UndistortMap::empty() const {
+    return offsets.empty();
+}
+
+int UndistortMap::height() const {
+    return h;
+}
+
+void UndistortMap::apply(const std::uint8_t *src, std::uint8_t *dst,
+                         int rowBegin, int rowEnd) const {
+    using lms::imaging::Format;
+
+    rowBegin = std::max(0, rowBegin);
+    rowEnd = std::min(h, rowEnd);
+
+    switch(format) {
+    case Format::GREY:
+        applyLuma(src, dst, 1, rowBegin, rowEnd);
+        break;
+    case Format::YUYV:
+        applyLuma(src, dst, 2, rowBegin, rowEnd);
+        applyChroma(src, dst, rowBegin, rowEnd);
+        break;
+    case Format::RGB:
+        applyRGB(src, dst, rowBegin, rowEnd);
+        break;
+    default:
+        break;
+    }
+}
+
+void UndistortMap::applyLuma(const std::uint8_t *src, std::uint8_t *dst, int stride,
+                             int rowBegin, int rowEnd) const {
+    const int srcRowBytes = w * stride;
+
+    for(int y = rowBegin; y < rowEnd; y++) {
+        const std::int32_t *off = &offsets[y * w];
+        const std::uint8_t *wx = &weightsX[y * w];
+        const std::uint8_t *wy = &weightsY[y * w];
+        std::uint8_t *out = dst + y * srcRowBytes;
+        int x = 0;
+
+#ifdef __SSE2__
+        // gather the four neighbours scalar, interpolate 8 pixels at once
+        alignas(16) std::uint16_t p00[8], p01[8], p10[8], p11[8], ax[8], ay[8];
+        alignas(16) std::uint8_t result[16];
+        const __m128i one = _mm_set1_epi16(WEIGHT_ONE);
+        const __m128i half = _mm_set1_epi16(WEIGHT_HALF);
+
+        for(; x + 8 <= w; x += 8) {
+            for(int i = 0; i < 8; i++) {
+                std::int32_t o = off[x + i];
+                if(o < 0) {
+                    p00[i] = p01[i] = p10[i] = p11[i] = ax[i] = ay[i] = 0;
+                    continue;
+                }
+                const std::uint8_t *p = src + o * stride;
+                p00[i] = p[0];
+                p01[i] = p[stride];
+                p10[i] = p[srcRowBytes];
+                p11[i] = p[srcRowBytes + stride];
+                ax[i] = wx[x + i];
+                ay[i] = wy[x + i];
+            }
+
+            __m128i vx = _mm_load_si128(reinterpret_cast<const __m128i*>(ax));
+            __m128i vy = _mm_load_si128(reinterpret_cast<const __m128i*>(ay));
+            __m128i ivx = _mm_sub_epi16(one, vx);
+            __m128i ivy = _mm_sub_epi16(one, vy);
+
+            __m128i top = _mm_add_epi16(
+                        _mm_mullo_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(p00)), ivx),
+                        _mm_mullo_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(p01)), vx));
+            __m128i bottom = _mm_add_epi16(
+                        _mm_mullo_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(p10)), ivx),
+                        _mm_mullo_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(p11)), vx));
+            top = _mm_srli_epi16(_mm_add_epi16(top, half), WEIGHT_BITS);
+            bottom = _mm_srli_epi16(_mm_add_epi16(bottom, half), WEIGHT_BITS);
+
+            __m128i res = _mm_add_epi16(_mm_mullo_epi16(top, ivy), _mm_mullo_epi16(bottom, vy));
+            res = _mm_srli_epi16(_mm_add_epi16(res, half), WEIGHT_BITS);
+            res = _mm_packus_epi16(res, res);
+
+            if(stride == 1) {
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), res);
+            } else {
+                _mm_store_si128(reinterpret_cast<__m128i*>(result), res);
+                for(int i = 0; i < 8; i++) {
+                    out[(x + i) * stride] = result[i];
+                }
+            }
+        }
+#endif
+
+        for(; x < w; x++) {
+            std::int32_t o = off[x];
+            if(o < 0) {
+                out[x * stride] = 0;
+                continue;
+            }
+            const std::uint8_t *p = src + o * stride;
+            out[x * stride] = interpolate(p[0], p[stride], p[srcRowBytes],
+                                          p[srcRowBytes + stride], wx[x], wy[x]);
+        }
+    }
+}
+
+void UndistortMap::applyChroma(const std::uint8_t *src, std::uint8_t *dst,
+                               int rowBegin, int rowEnd) const {
+    // U and V are shared by two pixels, use the nearest source pair
+    for(int y = rowBegin; y < rowEnd; y++) {
+        std::uint8_t *out = dst + y * w * 2;
+
+        for(int x = 0; x + 1 < w; x += 2) {
+            int i = y * w + x;
+            std::int32_t o = offsets[i];
+            if(o < 0) {
+                out[x * 2 + 1] = out[x * 2 + 3] = 128;
+                continue;
+            }
+
+            int sx = o % w + (weightsX[i] >= WEIGHT_HALF);
+            int sy = o / w + (weightsY[i] >= WEIGHT_HALF);
+            const std::uint8_t *pair = src + (sy * w + (sx & ~1)) * 2;
+            out[x * 2 + 1] = pair[1];
+            out[x * 2 + 3] = pair[3];
+        }
+    }
+}
+
+void UndistortMap::applyRGB(const std::uint8_t *src, std::uint8_t *dst,
+                            int rowBegin, int rowEnd) const {
+    const int srcRowBytes = w * 3;
+
+    for(int y = rowBegin; y < rowEnd; y++) {
+        std::uint8_t *out = dst + y * srcRowBytes;
+
+        for(int x = 0; x < w; x++) {
+            int i = y * w + x;
+            std::int32_t o = offsets[i];
+            if(o < 0) {
+                out[x * 3] = out[x * 3 + 1] = out[x * 3 + 2] = 0;
+                continue;
+            }
+
+            const std::uint8_t *p = src + o * 3;
+            for(int c = 0; c < 3; c++) {
+                out[x * 3 + c] = interpolate(p[c], p[3 + c], p[srcRowBytes + c],
+                                             p[srcRowBytes + 3 + c], weightsX[i], weightsY[i]);
+            }
+        }
+    }
+}
@@ -11,7 +11,8 @@ int xioctl(int64_t fh, int64_t request, void *arg)
     return r;
 }
 
-V4L2Wrapper::V4L2Wrapper(lms::logging::Logger &logger) : logger(logger), fd(0), ioType(0) {
+V4L2Wrapper::V4L2Wrapper(lms::logging::Logger &logger) : logger(logger), fd(0), ioType(0),
+    clockMapper(CLOCK_REALTIME) {
 }
 
 bool V4L2Wrapper::openDevice(const std::string &devicePath) {
@@ -69,6 +70,10 @@ bool V4L2Wrapper::isOpen() {
     return fd != 0;
 }
 
+bool V4L2Wrapper::isStreaming() const {
+    return ioType == V4L2_CAP_STREAMING;
+}
+
 std::uint32_t V4L2Wrapper::toV4L2(lms::imaging::Format fmt) {
     using lms::imaging::Format;
 
@@ -80,9 +85,41 @@ std::uint32_t V4L2Wrapper::toV4L2(lms::imaging::Format fmt) {
     }
 }
 
+std::uint32_t V4L2Wrapper::pixelFormatFromString(const std::string &name) {
+    lms::imaging::Format fmt = lms::imaging::formatFromString(name);
+    if(fmt != lms::imaging::Format::UNKNOWN) {
+        return toV4L2(fmt);
+    }
+
+    if(name == "SBGGR8") return V4L2_PIX_FMT_SBGGR8;
+    if(name == "SGBRG8") return V4L2_PIX_FMT_SGBRG8;
+    if(name == "SGRBG8") return V4L2_PIX_FMT_SGRBG8;
+    if(name == "SRGGB8") return V4L2_PIX_FMT_SRGGB8;
+    if(name == "MJPEG") return V4L2_PIX_FMT_MJPEG;
+
+    return 0;
+}
+
 bool V4L2Wrapper::setFormat(std::uint32_t width, std::uint32_t height, lms::imaging::Format fmt) {
+    // Set new values
+    int bytesPerPixel = lms::imaging::bytesPerPixel(fmt);
+
+    if(bytesPerPixel <= 0) {
+        logger.error("setFormat") << "Bytes per pixel is " << bytesPerPixel;
+        return false;
+    }
+
+    return setFormat(width, height, toV4L2(fmt));
+}
+
+bool V4L2Wrapper::setFormat(std::uint32_t width, std::uint32_t height, std::uint32_t pixelFormat) {
     // http://linuxtv.org/downloads/v4l-dvb-apis/vidioc-g-fmt.html
 
+    if(pixelFormat == 0) {
+        logger.error("setFormat") << "Unsupported pixel format";
+        return false;
+    }
+
     // get current pixel format of camera
     v4l2_format format;
     format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -91,20 +128,10 @@ bool V4L2Wrapper::setFormat(std::uint32_t width, std::uint32_t height, lms::imag
         return false;
     }
 
-    // Set new values
-    int bytesPerPixel = lms::imaging::bytesPerPixel(fmt);
-
-    if(bytesPerPixel <= 0) {
-        logger.error("setFormat") << "Bytes per pixel is " << bytesPerPixel;
-        return false;
-    }
-
     // http://linuxtv.org/downloads/v4l-dvb-apis/pixfmt.html#idp22265936
     format.fmt.pix.width = width;
     format.fmt.pix.height = height;
-    format.fmt.pix.pixelformat = toV4L2(fmt);
-    //format.fmt.pix.bytesperline = width * bytesPerPixel;
-    //format.fmt.pix.sizeimage = lms::imaging::imageBufferSize(width, height, fmt);
+    format.fmt.pix.pixelformat = pixelFormat;
 
     // try to set new values
     if (-1 == xioctl (fd, VIDIOC_S_FMT, &format)) {
@@ -114,12 +141,14 @@ bool V4L2Wrapper::setFormat(std::uint32_t width, std::uint32_t height, lms::imag
 
     // check if the settings are accepted
     if(format.fmt.pix.width != width || format.fmt.pix.height != height
-            || format.fmt.pix.pixelformat != toV4L2(fmt)) {
+            || format.fmt.pix.pixelformat != pixelFormat) {
 
         logger.error("setPixelFormat") << "Could not set width/height/pixelformat";
         return false;
     }
 
+    readBuffer.resize(format.fmt.pix.sizeimage);
+
     return true;
 }
 
@@ -268,6 +297,17 @@ bool V4L2Wrapper::setControl(const std::string& name, std::int32_t value)
     return setControl(cameraControls[name].id, value);
 }
 
+bool V4L2Wrapper::queryControl(const std::string& name, struct v4l2_queryctrl &ctrl) const
+{
+    auto it = cameraControls.find(name);
+    if( it == cameraControls.end() )
+    {
+        return false;
+    }
+    ctrl = it->second;
+    return true;
+}
+
 bool V4L2Wrapper::setCameraSettings(const lms::Config *cameraConfig) {
     for( auto it = cameraControls.begin(); it != cameraControls.end(); ++it )
     {
@@ -485,11 +525,57 @@ void V4L2Wrapper::getSupportedFramerates(std::vector<CameraResolution> &result,
     }
 }
 
-bool V4L2Wrapper::captureImage(lms::imaging::Image &image) {
+bool V4L2Wrapper::captureImage(lms::imaging::Image &image, FrameStatistics *stats) {
     if(ioType == V4L2_CAP_READWRITE) {
-        return read(fd, image.data(), image.size()) == image.size();
-    } else if(ioType == V4L2_CAP_STREAMING) {
+        if(read(fd, image.data(), image.size()) != image.size()) {
+            return false;
+        }
+        lastFrameTimestamp = lms::Time::now();
+        if(stats != nullptr) {
+            copyWithStatistics(nullptr, image.data(), image.width(), image.height(),
+                               image.format(), *stats);
+        }
+        return true;
+    }
+
+    Frame frame;
+    if(! dequeueFrame(frame)) {
+        return false;
+    }
+
+    /* Copy data to image */
+    if(frame.bytesused < static_cast<std::size_t>(image.size())) {
+        logger.error("captureImage") << "Frame has only " << frame.bytesused << " bytes";
+        requeueFrame(frame);
+        return false;
+    }
+
+    if(stats != nullptr) {
+        copyWithStatistics(image.data(), frame.data, image.width(), image.height(),
+                           image.format(), *stats);
+    } else {
+        memcpy(image.data(), frame.data, image.size());
+    }
+
+    return requeueFrame(frame);
+}
+
+bool V4L2Wrapper::dequeueFrame(Frame &frame) {
+    if(ioType == V4L2_CAP_READWRITE) {
+        ssize_t bytes = read(fd, readBuffer.data(), readBuffer.size());
+        if(bytes <= 0) {
+            logger.error("dequeueFrame") << "read " << strerror(errno);
+            return false;
+        }
 
+        frame.data = readBuffer.data();
+        frame.bytesused = bytes;
+        frame.timestamp = lms::Time::now();
+        frame.sequence = 0;
+        lastFrameTimestamp = frame.timestamp;
+        frame.index = -1;
+        return true;
+    } else if(ioType == V4L2_CAP_STREAMING) {
         v4l2_buffer buf;
         memset(&buf, 0, sizeof(buf));
         buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -497,32 +583,74 @@ bool V4L2Wrapper::captureImage(lms::imaging::Image &image) {
 
         /* Dequeue */
         if(-1 == xioctl(fd, VIDIOC_DQBUF, &buf)) {
-            logger.error("captureImage") << "VIDIOC_DQBUF " << strerror(errno);
+            logger.error("dequeueFrame") << "VIDIOC_DQBUF " << strerror(errno);
             return false;
         }
 
-        /* Copy data to image */
-        logger.info("captureImage") << "Image: " << image.size() << " " << buffers[buf.index].length;
+        lms::Time timestamp = mapTimestamp(buf);
 
-        //timeval now;
+        logger.debug("delay") << lms::Time::now() - timestamp;
 
-        lms::Time timestamp = lms::Time::fromMicros(buf.timestamp.tv_sec * 1000 * 1000 + buf.timestamp.tv_usec);
+        frame.data = static_cast<const std::uint8_t*>(buffers[buf.index].start);
+        // some drivers leave bytesused at 0 for uncompressed formats
+        frame.bytesused = buf.bytesused != 0 ? buf.bytesused : buffers[buf.index].length;
+        frame.timestamp = timestamp;
+        frame.sequence = buf.sequence;
+        frame.index = buf.index;
+        lastFrameTimestamp = timestamp;
+        return true;
+    } else {
+        logger.error("dequeueFrame") << "Wrong ioType";
+        return false;
+    }
+}
 
-        logger.info("delay") << lms::Time::now() - timestamp;
+lms::Time V4L2Wrapper::mapTimestamp(const v4l2_buffer &buf) {
+    const std::uint32_t type = buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK;
+    const std::int64_t micros = std::int64_t(buf.timestamp.tv_sec) * 1000 * 1000 + buf.timestamp.tv_usec;
 
-        memcpy(image.data(), buffers[buf.index].start, image.size());
+    if(type == V4L2_BUF_FLAG_TIMESTAMP_COPY || micros == 0) {
+        // no capture time available, dequeue time is the best guess
+        return lms::Time::now();
+    }
 
-        /* Queue buffer for next frame */
-        if(-1 == xioctl(fd, VIDIOC_QBUF, &buf)) {
-            logger.error("captureImage") << "VIDIOC_QBUF " << strerror(errno);
-            return false;
-        }
+    // drivers that do not report the type use the wall clock
+    clockid_t clock = type == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC ? CLOCK_MONOTONIC : CLOCK_REALTIME;
+    if(clock != clockMapper.clock()) {
+        clockMapper.setClock(clock);
+        logger.info("mapTimestamp") << "Buffer timestamps use "
+            << (clock == CLOCK_MONOTONIC ? "CLOCK_MONOTONIC" : "CLOCK_REALTIME") << " at "
+            << ((buf.flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) == V4L2_BUF_FLAG_TSTAMP_SRC_SOE
+                ? "start of exposure" : "end of frame");
+    }
 
+    clockMapper.update();
+    return clockMapper.map(micros);
+}
+
+lms::Time V4L2Wrapper::lastTimestamp() const {
+    return lastFrameTimestamp;
+}
+
+bool V4L2Wrapper::requeueFrame(const Frame &frame) {
+    if(frame.index < 0) {
+        // read IO, nothing to give back
         return true;
-    } else {
-        logger.error("captureImage") << "Wrong ioType";
+    }
+
+    v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = frame.index;
+
+    /* Queue buffer for next frame */
+    if(-1 == xioctl(fd, VIDIOC_QBUF, &buf)) {
+        logger.error("requeueFrame") << "VIDIOC_QBUF " << strerror(errno);
         return false;
     }
+
+    return true;
 }
 
 bool V4L2Wrapper::initBuffers() {
@@ -0,0 +1,112 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(int threads) : queueHead(0), queueSize(0), running(true), batchTask(nullptr),
+    batchContext(nullptr), batchCount(0), batchNext(0), batchPending(0) {
+    for(int i = 0; i < threads; i++) {
+        this->threads.emplace_back(&WorkerPool::work, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    cond.notify_all();
+
+    for(std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+int WorkerPool::size() const {
+    return static_cast<int>(threads.size());
+}
+
+void WorkerPool::post(std::function<void()> task) {
+    if(threads.empty()) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(queueSize == queue.size()) {
+            // full, unroll the ring into a larger one
+            std::vector<std::function<void()>> larger(std::max<std::size_t>(8, 2 * queue.size()));
+            for(std::size_t i = 0; i < queueSize; i++) {
+                larger[i] = std::move(queue[(queueHead + i) % queue.size()]);
+            }
+            queue.swap(larger);
+            queueHead = 0;
+        }
+        queue[(queueHead + queueSize) % queue.size()] = std::move(task);
+        queueSize++;
+    }
+    cond.notify_one();
+}
+
+void WorkerPool::runBatch(int count, void (*task)(const void*, int), const void *context) {
+    if(count <= 0) {
+        return;
+    }
+
+    // indices are handed out from shared counters, nothing is queued or allocated
+    std::unique_lock<std::mutex> lock(mutex);
+    batchTask = task;
+    batchContext = context;
+    batchCount = count;
+    batchNext = 0;
+    batchPending = count;
+    cond.notify_all();
+
+    while(batchNext < batchCount) {
+        runBatchItem(lock);
+    }
+
+    batchDone.wait(lock, [this] { return batchPending == 0; });
+    batchTask = nullptr;
+}
+
+void WorkerPool::runBatchItem(std::unique_lock<std::mutex> &lock) {
+    int index = batchNext++;
+    void (*task)(const void*, int) = batchTask;
+    const void *context = batchContext;
+
+    lock.unlock();
+    task(context, index);
+    lock.lock();
+
+    if(--batchPending == 0) {
+        batchDone.notify_all();
+    }
+}
+
+void WorkerPool::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(true) {
+        cond.wait(lock, [this] {
+            return ! running || queueSize > 0 || batchNext < batchCount;
+        });
+
+        if(batchNext < batchCount) {
+            runBatchItem(lock);
+            continue;
+        }
+
+        if(! running && queueSize == 0) {
+            return;
+        }
+
+        std::function<void()> task = std::move(queue[queueHead]);
+        queue[queueHead] = nullptr;
+        queueHead = (queueHead + 1) % queue.size();
+        queueSize--;
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}